@@ -0,0 +1,60 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include <cpu.h>
+#include <bus.h>
+
+/*
+ * Runtime for ROMs translated ahead of time by tools/aot8080.c.
+ *
+ * The generated unit defines aot_run(): starting at registers.pc it runs
+ * translated blocks while the next one ends before cycle_limit and fewer
+ * than budget instructions have run, and returns the instructions executed.
+ * It returns 0 straight away when registers.pc is not the start of a
+ * translated block (RAM-resident code, PCHL into the middle of nowhere),
+ * the block is not all on ROM pages of the machine or it would reach
+ * cycle_limit; the caller then interprets. Only ROM pages are run, as
+ * nothing can store over them, and the caller only calls it for a ROM
+ * image holding aot_image.
+ */
+uint64_t aot_run(Cpu8080 *cpu, uint64_t cycle_limit, uint64_t budget);
+
+/* The bytes aot_run() was translated from, [aot_image_start, aot_image_end) of the address space */
+extern const uint32_t aot_image_start;
+extern const uint32_t aot_image_end;
+extern const uint8_t aot_image[];
+
+/* Helpers used by the generated code, where r is &cpu->registers */
+#define AOT_MEM(address)    read_memory(cpu, (address))
+
+/* Conditions of Jcc, as the interpreter's handlers test them */
+#define AOT_COND_NZ         (!(r->F & FLAG_ZERO))
+#define AOT_COND_Z          (r->F & FLAG_ZERO)
+#define AOT_COND_NC         (!(r->F & FLAG_CARRY))
+#define AOT_COND_C          (r->F & FLAG_CARRY)
+#define AOT_COND_PO         (!(r->F & FLAG_PARITY))
+#define AOT_COND_PE         (r->F & FLAG_PARITY)
+#define AOT_COND_P          (!(r->F & FLAG_SIGN))
+#define AOT_COND_M          (r->F & FLAG_SIGN)
+
+#define AOT_ROM_PAGE(address) (cpu->memory_map.type[(address) >> MEMORY_PAGE_SHIFT] == PAGE_ROM)
+
+/*
+ * Entry of a translated block, from address to last: leave with pc at the
+ * block when it is not all on ROM, would reach the next interrupt point or
+ * exceed the budget, else retire it. A taken conditional CALL or RET at
+ * its end adds the difference between taken_cycles and block_cycles itself.
+ */
+#define AOT_BLOCK(address, last, ops, block_cycles, taken_cycles)               \
+    do {                                                                        \
+        if (!AOT_ROM_PAGE(address) || !AOT_ROM_PAGE(last) ||                    \
+            cpu->cycles + (taken_cycles) >= cycle_limit || executed >= budget)  \
+        {                                                                       \
+            r->pc = (address);                                                  \
+            return executed;                                                    \
+        }                                                                       \
+        cpu->cycles += (block_cycles);                                          \
+        executed += (ops);                                                      \
+    } while (0)
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <memory_map.h>
+
+#define BLOCK_MAX_OPS 32
+
+/* Most guest bytes a block covers, BLOCK_MAX_OPS three-byte instructions */
+#define BLOCK_MAX_SIZE (BLOCK_MAX_OPS * 3)
+
+/* Direct-mapped on the entry PC, must be a power of two */
+#define BLOCK_CACHE_SIZE 1024
+
+/* Pages for the coarse checks (loading a state, idioms); stores are checked per byte */
+#define BLOCK_PAGE_SHIFT MEMORY_PAGE_SHIFT
+#define BLOCK_PAGE_COUNT MEMORY_PAGE_COUNT
+
+/*
+ * Superinstructions: adjacent opcode pairs that execute_block() runs as one
+ * handler, picked from PAIR_PROFILE runs of Space Invaders. The fused
+ * handler sits on the first micro-op and skips the second, which keeps its
+ * opcode and operand; the block's cycles and count do not change.
+ */
+typedef enum Superinstruction {
+    SUPER_DCR_B_JNZ,
+    SUPER_ANA_A_JNZ,
+    SUPER_ANA_A_JZ,
+    SUPER_MOV_A_M_ANA_A,
+    SUPER_MOV_A_M_INX_H,
+    SUPER_INX_H_DCR_B,
+    SUPER_INX_H_INX_D,
+    SUPER_LDA_ANA_A,
+    SUPER_LDA_CPI,
+    SUPER_MOV_M_A_INX_H,
+    SUPER_LDAX_D_MOV_M_A,
+    SUPER_COUNT
+} Superinstruction;
+
+/*
+ * Loop idioms: copy, fill and compare loops with a known shape that
+ * emulate_blocks() can run as host memory operations. Every one but
+ * IDIOM_COMPARE is a single block jumping back to its own start.
+ */
+typedef enum Idiom {
+    IDIOM_NONE,
+    IDIOM_COPY,             // LDAX D; MOV M,A; INX H; INX D; DCR B; JNZ
+    IDIOM_FILL,             // MOV M,A; INX H; DCR B; JNZ
+    IDIOM_FILL_IMMEDIATE,   // MVI M,d8; INX H; DCR B; JNZ
+    IDIOM_FILL_TO_H,        // MVI M,d8; INX H; MOV A,H; CPI d8; JNZ
+    IDIOM_COMPARE,          // LDAX D; CMP M; JNZ out, then INX H; INX D; DCR B; JNZ back in the next block
+} Idiom;
+
+/* Bytes of the block following an IDIOM_COMPARE head, after its JNZ: INX H; INX D; DCR B; JNZ a16 */
+#define IDIOM_COMPARE_TAIL_SIZE 6
+
+typedef struct MicroOp {
+    const void *handler;    // threaded handler address, NULL in switch builds
+    uint16_t operand;       // pre-extracted d8 / d16 / a16 immediate
+    uint8_t opcode;
+} MicroOp;
+
+/*
+ * A straight-line run of guest code, decoded once. It ends after the first
+ * control transfer, I/O or interrupt-enable instruction, or at BLOCK_MAX_OPS.
+ */
+typedef struct Block {
+    uint16_t start;         // entry PC
+    uint16_t size;          // bytes of guest code covered
+    uint16_t cycles;        // sum of INSTRUCTION_CYCLES over ops
+    uint16_t taken_cycles;  // the same with a closing conditional CALL or RET taken
+    uint8_t count;          // ops in use, 0 marks a free slot
+    uint16_t hits;          // executions since decoding, up to JIT_HOT_THRESHOLD
+    bool spin;              // jumps back to its own start and stores nothing: a possible busy-wait
+    uint8_t idiom;          // Idiom the loop starting here matches
+    MicroOp ops[BLOCK_MAX_OPS];
+} Block;
+
+typedef struct BlockCache {
+    Block blocks[BLOCK_CACHE_SIZE];
+    uint16_t code_pages[BLOCK_PAGE_COUNT];  // cached blocks touching each page
+    uint8_t code_bytes[0x10000];            // cached blocks covering each byte, at most BLOCK_MAX_SIZE
+} BlockCache;
+
+BlockCache* block_cache_create();
+void block_cache_free(BlockCache *cache);
+
+Block* block_cache_lookup(BlockCache *cache, uint16_t pc);
+
+/*
+ * Decodes only from RAM and ROM pages; NULL when pc is not on one or holds an
+ * undefined opcode. handlers holds the 256 opcode handlers followed by the
+ * SUPER_COUNT superinstruction ones, or is NULL for switch dispatch.
+ */
+Block* block_cache_decode(BlockCache *cache, const MemoryMap *map, uint16_t pc, const void *const *handlers);
+
+/* Evict the blocks covering address, a single load when there are none */
+void block_cache_invalidate(BlockCache *cache, uint16_t address);
+
+/* Evict every block with code on page (address >> BLOCK_PAGE_SHIFT) */
+void block_cache_invalidate_page(BlockCache *cache, uint8_t page);
+
+/* Whether tail holds the second block of an IDIOM_COMPARE loop whose head is at head */
+bool idiom_compare_tail(const uint8_t tail[IDIOM_COMPARE_TAIL_SIZE], uint16_t head);
+
+/* Instructions after which the next PC or the interrupt state is only known at run time */
+bool ends_block(uint8_t opcode);
+
+#endif
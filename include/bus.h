@@ -0,0 +1,89 @@
+#ifndef BUS_H
+#define BUS_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <cpu.h>
+
+/*
+ * The 8080's single 64 KB address space, as laid out by cpu->memory_map.
+ * Instruction fetch, operands and data all go through it, so code copied
+ * into RAM (CP/M programs, self-modifying code) is decoded exactly as it
+ * was last written.
+ *
+ * Addresses are uint16_t, so anything past 0xFFFF wraps to 0x0000 as it
+ * does on the real bus. RAM and ROM pages are a pointer index; only MMIO
+ * pages and stores to ROM leave the inline path.
+ */
+
+static inline uint8_t read_memory(Cpu8080 *cpu, uint16_t address)
+{
+    const uint8_t *page = cpu->memory_map.read[address >> MEMORY_PAGE_SHIFT];
+
+    if (page)
+        return page[address & MEMORY_PAGE_MASK];
+
+    return memory_map_read(cpu, address);
+}
+
+/* Little-endian word at address, the high byte wrapping to 0x0000 from 0xFFFF */
+static inline uint16_t read_memory_word(Cpu8080 *cpu, uint16_t address)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    const uint8_t *page = cpu->memory_map.read[address >> MEMORY_PAGE_SHIFT];
+
+    if (page && (address & MEMORY_PAGE_MASK) != MEMORY_PAGE_MASK)
+    {
+        uint16_t word;
+
+        // one unaligned load instead of two byte loads and a shift
+        memcpy(&word, &page[address & MEMORY_PAGE_MASK], sizeof(word));
+        return word;
+    }
+#endif
+
+    return read_memory(cpu, address) | read_memory(cpu, address + 1) << 8;
+}
+
+static inline void write_memory(Cpu8080 *cpu, uint16_t address, uint8_t value)
+{
+    uint8_t *page = cpu->memory_map.write[address >> MEMORY_PAGE_SHIFT];
+
+    if (page == NULL)
+    {
+        memory_map_write(cpu, address, value);
+        return;
+    }
+
+    page[address & MEMORY_PAGE_MASK] = value;
+
+    // a store through a mirror changes the code at the page it repeats
+    uint16_t target = (uint16_t)(&page[address & MEMORY_PAGE_MASK] - cpu->memory);
+
+    if (cpu->block_cache && cpu->block_cache->code_bytes[target])
+        block_cache_invalidate(cpu->block_cache, target);
+
+    if (cpu->jit && cpu->jit->code_bytes[target])
+        jit_invalidate(cpu->jit, target);
+}
+
+/* Opcode at registers.pc */
+static inline uint8_t fetch_opcode(Cpu8080 *cpu)
+{
+    return read_memory(cpu, cpu->registers.pc);
+}
+
+/* d8 / port operand following the opcode */
+static inline uint8_t read_byte(Cpu8080 *cpu)
+{
+    return read_memory(cpu, cpu->registers.pc + 1);
+}
+
+/* d16 / a16 operand following the opcode */
+static inline uint16_t read_byte_address(Cpu8080 *cpu)
+{
+    return read_memory_word(cpu, cpu->registers.pc + 1);
+}
+
+#endif
@@ -6,4 +6,7 @@
 #define DEBUG_ON 0
 
 void print_opcode(Cpu8080 *cpu);    
+
+/* Most frequent of the 65536 opcode pair counts, first opcode in the high byte */
+void print_pair_profile(const uint64_t *counts, unsigned top);
 #endif // DEBUG_H
@@ -14,11 +14,14 @@
 #define rL cpu->registers.L
 
 #define FLAG_CARRY              0x01
+#define FLAG_ALWAYS_ONE         0x02
 #define FLAG_PARITY             0x04
 #define FLAG_AUX_CARRY          0x10
 #define FLAG_ZERO               0x40
 #define FLAG_SIGN               0x80
 
+#define FLAG_MASK               (FLAG_SIGN | FLAG_ZERO | FLAG_AUX_CARRY | FLAG_PARITY | FLAG_CARRY)
+
 #define FLAG_CARRY_POS          0
 #define FLAG_PARITY_POS         2
 #define FLAG_AUX_CARRY_POS      4
@@ -42,9 +45,4 @@
 uint16_t twoU8_to_u16adress(uint8_t byte1, uint8_t byte2);
 uint16_t twoU8_to_u16value(uint8_t byte1, uint8_t byte2);
 
-uint8_t read_byte(Cpu8080 *cpu);
-uint16_t read_byte_address(Cpu8080 *cpu);
-
-Flags byteToFlags(uint8_t byte);
-
 #endif
\ No newline at end of file
@@ -0,0 +1,86 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <block_cache.h>
+
+/* Executions of a cached block before it is translated to host code */
+#define JIT_HOT_THRESHOLD 16
+
+/* Executable memory for translated blocks, flushed as a whole when full */
+#define JIT_ARENA_SIZE (1 << 20)
+
+/* Translated entry points, direct-mapped on the guest PC, must be a power of two */
+#define JIT_TABLE_SIZE 4096
+
+/* Block exits to a known PC, chained or waiting for their target; two per translation at most */
+#define JIT_MAX_LINKS (2 * JIT_TABLE_SIZE)
+
+struct Cpu8080;
+
+/*
+ * Interpreter services called from translated code. Both return non-zero
+ * once a store has dropped translated code, the running one maybe.
+ */
+typedef uint8_t (*JitStepFn)(struct Cpu8080 *cpu, uint8_t opcode, uint16_t operand);
+typedef uint8_t (*JitStoreFn)(struct Cpu8080 *cpu, uint16_t address, uint8_t value);
+
+/* Loads from pages without a read pointer (MMIO) */
+typedef uint8_t (*JitLoadFn)(struct Cpu8080 *cpu, uint16_t address);
+
+typedef struct JitEntry {
+    const uint8_t *code;
+    const uint8_t *end;     // past the translation's host code, exit stubs included
+    uint16_t pc;
+    uint16_t size;          // guest bytes translated
+} JitEntry;
+
+/* An exit to a known PC, jumping to the target's translation while there is one and to exit otherwise */
+typedef struct JitLink {
+    uint8_t *patch;         // rel32 field of the exit jump
+    uint16_t target;
+} JitLink;
+
+typedef struct Jit {
+    uint8_t *arena;
+    size_t used;
+    size_t runtime_size;    // enter/exit stubs at the start of the arena, kept across flushes
+    const uint8_t *enter;
+    const uint8_t *exit;
+    JitStepFn step;
+    JitStoreFn store;
+    JitLoadFn load;
+    bool invalidated;       // a store dropped translated code, whatever runs leaves after it
+    unsigned link_count;
+    JitEntry table[JIT_TABLE_SIZE];
+    JitLink links[JIT_MAX_LINKS];
+    uint16_t code_pages[BLOCK_PAGE_COUNT];  // translations touching each page
+    uint8_t code_bytes[0x10000];            // translations covering each byte, at most BLOCK_MAX_SIZE
+} Jit;
+
+/* NULL when the host has no backend (anything but x86-64 Unix) */
+Jit* jit_create(JitStepFn step, JitStoreFn store, JitLoadFn load);
+void jit_free(Jit *jit);
+void jit_flush(Jit *jit);
+
+const void* jit_lookup(Jit *jit, uint16_t pc);
+const void* jit_compile(Jit *jit, const Block *block);
+
+/*
+ * Drop the translations covering address, whose guest code a store just
+ * changed, and send the exits chained into them back to the dispatcher.
+ * Other translations stay.
+ */
+void jit_invalidate(Jit *jit, uint16_t address);
+
+/*
+ * Run translated code from entry, following chained blocks while the next
+ * one ends before cycle_limit and fewer than budget instructions have run.
+ * Returns the number of instructions executed.
+ */
+uint64_t jit_run(Jit *jit, struct Cpu8080 *cpu, const void *entry, uint64_t cycle_limit, uint64_t budget);
+
+#endif
@@ -7,4 +7,7 @@
 #define WIDTH  256
 #define HEIGHT 224
 
+/* Run length of the headless build when neither -c nor -f is given: ten emulated seconds */
+#define HEADLESS_DEFAULT_FRAMES (10 * TARGET_FPS)
+
 #endif
\ No newline at end of file
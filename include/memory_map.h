@@ -0,0 +1,104 @@
+#ifndef MEMORY_MAP_H
+#define MEMORY_MAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+/* Mapping granularity */
+#define MEMORY_PAGE_SHIFT 8
+#define MEMORY_PAGE_SIZE  (1 << MEMORY_PAGE_SHIFT)
+#define MEMORY_PAGE_MASK  (MEMORY_PAGE_SIZE - 1)
+#define MEMORY_PAGE_COUNT (0x10000 >> MEMORY_PAGE_SHIFT)
+
+struct Cpu8080;
+
+typedef enum PageType {
+    PAGE_RAM,
+    PAGE_ROM,       // stores are dropped
+    PAGE_MIRROR,    // another page's bytes seen at a second address
+    PAGE_MMIO       // every access goes to the page's handlers
+} PageType;
+
+/*
+ * A page's bytes shared between machines: cloned from one another (see
+ * clone_cpu()), or running the process' ROM image (see acquire_rom()).
+ * A store to a shared RAM page copies it back to the machine's own memory
+ * first. Freed with its last user; machines may run on separate threads.
+ */
+typedef struct SharedPage {
+    atomic_uint users;
+    uint8_t bytes[MEMORY_PAGE_SIZE];
+} SharedPage;
+
+/* A SharedPage holding a copy of bytes, with one user */
+SharedPage* shared_page_create(const uint8_t *bytes);
+void shared_page_release(SharedPage *shared);
+
+typedef uint8_t (*MmioRead)(struct Cpu8080 *cpu, uint16_t address);
+typedef void (*MmioWrite)(struct Cpu8080 *cpu, uint16_t address, uint8_t value);
+
+/*
+ * What each 256-byte page of the address space is backed by.
+ *
+ * RAM and ROM pages are backed by the same offset of memory (the 64 KB
+ * cpu->memory), unless the page is shared: then read points at the
+ * SharedPage's bytes and write is NULL until a store takes a copy. Mirror
+ * pages point at the bytes of the page they repeat, and at its SharedPage
+ * while that is shared. The loads and stores of bus.h index read/write
+ * straight away and only call out when the pointer is NULL.
+ */
+typedef struct MemoryMap {
+    uint8_t *memory;
+    uint8_t *read[MEMORY_PAGE_COUNT];       // NULL for MMIO
+    uint8_t *write[MEMORY_PAGE_COUNT];      // NULL for ROM and MMIO
+    MmioRead mmio_read[MEMORY_PAGE_COUNT];
+    MmioWrite mmio_write[MEMORY_PAGE_COUNT];
+    uint8_t type[MEMORY_PAGE_COUNT];
+    SharedPage *shared[MEMORY_PAGE_COUNT];  // NULL while the page's bytes are its own
+} MemoryMap;
+
+/* Map the whole address space as RAM backed by memory */
+void memory_map_init(MemoryMap *map, uint8_t *memory);
+
+/* start and end are inclusive and must cover whole pages */
+void map_ram(MemoryMap *map, uint16_t start, uint16_t end);
+void map_rom(MemoryMap *map, uint16_t start, uint16_t end);
+void map_mirror(MemoryMap *map, uint16_t start, uint16_t end, uint16_t source_start, uint16_t source_end);
+void map_mmio(MemoryMap *map, uint16_t start, uint16_t end, MmioRead read, MmioWrite write);
+
+/* Map the page at address as ROM reading from shared, which gains a user; address must be page aligned */
+void map_shared_rom(MemoryMap *map, uint16_t address, SharedPage *shared);
+
+/* Whether address is RAM or ROM of its own rather than a mirror or MMIO, where blocks may be decoded */
+static inline bool page_is_direct(const MemoryMap *map, uint16_t address)
+{
+    uint8_t type = map->type[address >> MEMORY_PAGE_SHIFT];
+
+    return type == PAGE_RAM || type == PAGE_ROM;
+}
+
+/* Byte at address of a page_is_direct() page, without side effects */
+static inline uint8_t direct_byte(const MemoryMap *map, uint16_t address)
+{
+    return map->read[address >> MEMORY_PAGE_SHIFT][address & MEMORY_PAGE_MASK];
+}
+
+/*
+ * Share every RAM and ROM page of parent with child, a map of the same
+ * layout over child_memory, and put parent's own pages in SharedPages on
+ * the way. Costs the pages parent wrote since it was last shared.
+ */
+void memory_map_share(MemoryMap *parent, MemoryMap *child, uint8_t *child_memory);
+
+/* Copy page's shared bytes back to its own offset of memory, a no-op for pages that are not shared */
+void memory_map_unshare(MemoryMap *map, unsigned page);
+
+/* Drop the map's references to SharedPages without copying them back */
+void memory_map_release(MemoryMap *map);
+
+/* Slow paths of bus.h for pages without a read or write pointer */
+uint8_t memory_map_read(struct Cpu8080 *cpu, uint16_t address);
+void memory_map_write(struct Cpu8080 *cpu, uint16_t address, uint8_t value);
+
+#endif
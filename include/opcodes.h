@@ -0,0 +1,280 @@
+#ifndef OPCODES_H
+#define OPCODES_H
+
+/*
+ * The 8080 instruction set, one row per opcode:
+ *
+ *   X(opcode, kind, mnemonic, length, cycles, taken)
+ *
+ * kind       DEFINED, or UNDEFINED for the undocumented aliases this core
+ *            stops on (they have no handler)
+ * mnemonic   printf format for the disassembly, given the operand
+ * length     bytes, opcode included
+ * cycles     clock states; for conditional CALL and RET those of the
+ *            condition failing
+ * taken      clock states with the condition holding, equal to cycles for
+ *            every other instruction
+ *
+ * cpu.h builds INSTRUCTION_LENGTH, INSTRUCTION_CYCLES and
+ * INSTRUCTION_CYCLES_TAKEN from it, cpu.c the dispatch tables and debug.c
+ * the disassembler.
+ */
+#define OPCODES(X) \
+    X(0x00, DEFINED,  "NOP",               1,  4,  4) \
+    X(0x01, DEFINED,  "LXI    B,#$%04X",   3, 10, 10) \
+    X(0x02, DEFINED,  "STAX   B",          1,  7,  7) \
+    X(0x03, DEFINED,  "INX    B",          1,  5,  5) \
+    X(0x04, DEFINED,  "INR    B",          1,  5,  5) \
+    X(0x05, DEFINED,  "DCR    B",          1,  5,  5) \
+    X(0x06, DEFINED,  "MVI    B,#$%02X",   2,  7,  7) \
+    X(0x07, DEFINED,  "RLC",               1,  4,  4) \
+    X(0x08, DEFINED,  "*NOP",              1,  4,  4) \
+    X(0x09, DEFINED,  "DAD    B",          1, 10, 10) \
+    X(0x0A, DEFINED,  "LDAX   B",          1,  7,  7) \
+    X(0x0B, DEFINED,  "DCX    B",          1,  5,  5) \
+    X(0x0C, DEFINED,  "INR    C",          1,  5,  5) \
+    X(0x0D, DEFINED,  "DCR    C",          1,  5,  5) \
+    X(0x0E, DEFINED,  "MVI    C,#$%02X",   2,  7,  7) \
+    X(0x0F, DEFINED,  "RRC",               1,  4,  4) \
+    X(0x10, DEFINED,  "*NOP",              1,  4,  4) \
+    X(0x11, DEFINED,  "LXI    D,#$%04X",   3, 10, 10) \
+    X(0x12, DEFINED,  "STAX   D",          1,  7,  7) \
+    X(0x13, DEFINED,  "INX    D",          1,  5,  5) \
+    X(0x14, DEFINED,  "INR    D",          1,  5,  5) \
+    X(0x15, DEFINED,  "DCR    D",          1,  5,  5) \
+    X(0x16, DEFINED,  "MVI    D,#$%02X",   2,  7,  7) \
+    X(0x17, DEFINED,  "RAL",               1,  4,  4) \
+    X(0x18, DEFINED,  "*NOP",              1,  4,  4) \
+    X(0x19, DEFINED,  "DAD    D",          1, 10, 10) \
+    X(0x1A, DEFINED,  "LDAX   D",          1,  7,  7) \
+    X(0x1B, DEFINED,  "DCX    D",          1,  5,  5) \
+    X(0x1C, DEFINED,  "INR    E",          1,  5,  5) \
+    X(0x1D, DEFINED,  "DCR    E",          1,  5,  5) \
+    X(0x1E, DEFINED,  "MVI    E,#$%02X",   2,  7,  7) \
+    X(0x1F, DEFINED,  "RAR",               1,  4,  4) \
+    X(0x20, DEFINED,  "*NOP",              1,  4,  4) \
+    X(0x21, DEFINED,  "LXI    H,#$%04X",   3, 10, 10) \
+    X(0x22, DEFINED,  "SHLD   $%04X",      3, 16, 16) \
+    X(0x23, DEFINED,  "INX    H",          1,  5,  5) \
+    X(0x24, DEFINED,  "INR    H",          1,  5,  5) \
+    X(0x25, DEFINED,  "DCR    H",          1,  5,  5) \
+    X(0x26, DEFINED,  "MVI    H,#$%02X",   2,  7,  7) \
+    X(0x27, DEFINED,  "DAA",               1,  4,  4) \
+    X(0x28, DEFINED,  "*NOP",              1,  4,  4) \
+    X(0x29, DEFINED,  "DAD    H",          1, 10, 10) \
+    X(0x2A, DEFINED,  "LHLD   $%04X",      3, 16, 16) \
+    X(0x2B, DEFINED,  "DCX    H",          1,  5,  5) \
+    X(0x2C, DEFINED,  "INR    L",          1,  5,  5) \
+    X(0x2D, DEFINED,  "DCR    L",          1,  5,  5) \
+    X(0x2E, DEFINED,  "MVI    L,#$%02X",   2,  7,  7) \
+    X(0x2F, DEFINED,  "CMA",               1,  4,  4) \
+    X(0x30, DEFINED,  "*NOP",              1,  4,  4) \
+    X(0x31, DEFINED,  "LXI    SP,#$%04X",  3, 10, 10) \
+    X(0x32, DEFINED,  "STA    $%04X",      3, 13, 13) \
+    X(0x33, DEFINED,  "INX    SP",         1,  5,  5) \
+    X(0x34, DEFINED,  "INR    M",          1, 10, 10) \
+    X(0x35, DEFINED,  "DCR    M",          1, 10, 10) \
+    X(0x36, DEFINED,  "MVI    M,#$%02X",   2, 10, 10) \
+    X(0x37, DEFINED,  "STC",               1,  4,  4) \
+    X(0x38, DEFINED,  "*NOP",              1,  4,  4) \
+    X(0x39, DEFINED,  "DAD    SP",         1, 10, 10) \
+    X(0x3A, DEFINED,  "LDA    $%04X",      3, 13, 13) \
+    X(0x3B, DEFINED,  "DCX    SP",         1,  5,  5) \
+    X(0x3C, DEFINED,  "INR    A",          1,  5,  5) \
+    X(0x3D, DEFINED,  "DCR    A",          1,  5,  5) \
+    X(0x3E, DEFINED,  "MVI    A,#$%02X",   2,  7,  7) \
+    X(0x3F, DEFINED,  "CMC",               1,  4,  4) \
+    X(0x40, DEFINED,  "MOV    B,B",        1,  5,  5) \
+    X(0x41, DEFINED,  "MOV    B,C",        1,  5,  5) \
+    X(0x42, DEFINED,  "MOV    B,D",        1,  5,  5) \
+    X(0x43, DEFINED,  "MOV    B,E",        1,  5,  5) \
+    X(0x44, DEFINED,  "MOV    B,H",        1,  5,  5) \
+    X(0x45, DEFINED,  "MOV    B,L",        1,  5,  5) \
+    X(0x46, DEFINED,  "MOV    B,M",        1,  7,  7) \
+    X(0x47, DEFINED,  "MOV    B,A",        1,  5,  5) \
+    X(0x48, DEFINED,  "MOV    C,B",        1,  5,  5) \
+    X(0x49, DEFINED,  "MOV    C,C",        1,  5,  5) \
+    X(0x4A, DEFINED,  "MOV    C,D",        1,  5,  5) \
+    X(0x4B, DEFINED,  "MOV    C,E",        1,  5,  5) \
+    X(0x4C, DEFINED,  "MOV    C,H",        1,  5,  5) \
+    X(0x4D, DEFINED,  "MOV    C,L",        1,  5,  5) \
+    X(0x4E, DEFINED,  "MOV    C,M",        1,  7,  7) \
+    X(0x4F, DEFINED,  "MOV    C,A",        1,  5,  5) \
+    X(0x50, DEFINED,  "MOV    D,B",        1,  5,  5) \
+    X(0x51, DEFINED,  "MOV    D,C",        1,  5,  5) \
+    X(0x52, DEFINED,  "MOV    D,D",        1,  5,  5) \
+    X(0x53, DEFINED,  "MOV    D,E",        1,  5,  5) \
+    X(0x54, DEFINED,  "MOV    D,H",        1,  5,  5) \
+    X(0x55, DEFINED,  "MOV    D,L",        1,  5,  5) \
+    X(0x56, DEFINED,  "MOV    D,M",        1,  7,  7) \
+    X(0x57, DEFINED,  "MOV    D,A",        1,  5,  5) \
+    X(0x58, DEFINED,  "MOV    E,B",        1,  5,  5) \
+    X(0x59, DEFINED,  "MOV    E,C",        1,  5,  5) \
+    X(0x5A, DEFINED,  "MOV    E,D",        1,  5,  5) \
+    X(0x5B, DEFINED,  "MOV    E,E",        1,  5,  5) \
+    X(0x5C, DEFINED,  "MOV    E,H",        1,  5,  5) \
+    X(0x5D, DEFINED,  "MOV    E,L",        1,  5,  5) \
+    X(0x5E, DEFINED,  "MOV    E,M",        1,  7,  7) \
+    X(0x5F, DEFINED,  "MOV    E,A",        1,  5,  5) \
+    X(0x60, DEFINED,  "MOV    H,B",        1,  5,  5) \
+    X(0x61, DEFINED,  "MOV    H,C",        1,  5,  5) \
+    X(0x62, DEFINED,  "MOV    H,D",        1,  5,  5) \
+    X(0x63, DEFINED,  "MOV    H,E",        1,  5,  5) \
+    X(0x64, DEFINED,  "MOV    H,H",        1,  5,  5) \
+    X(0x65, DEFINED,  "MOV    H,L",        1,  5,  5) \
+    X(0x66, DEFINED,  "MOV    H,M",        1,  7,  7) \
+    X(0x67, DEFINED,  "MOV    H,A",        1,  5,  5) \
+    X(0x68, DEFINED,  "MOV    L,B",        1,  5,  5) \
+    X(0x69, DEFINED,  "MOV    L,C",        1,  5,  5) \
+    X(0x6A, DEFINED,  "MOV    L,D",        1,  5,  5) \
+    X(0x6B, DEFINED,  "MOV    L,E",        1,  5,  5) \
+    X(0x6C, DEFINED,  "MOV    L,H",        1,  5,  5) \
+    X(0x6D, DEFINED,  "MOV    L,L",        1,  5,  5) \
+    X(0x6E, DEFINED,  "MOV    L,M",        1,  7,  7) \
+    X(0x6F, DEFINED,  "MOV    L,A",        1,  5,  5) \
+    X(0x70, DEFINED,  "MOV    M,B",        1,  7,  7) \
+    X(0x71, DEFINED,  "MOV    M,C",        1,  7,  7) \
+    X(0x72, DEFINED,  "MOV    M,D",        1,  7,  7) \
+    X(0x73, DEFINED,  "MOV    M,E",        1,  7,  7) \
+    X(0x74, DEFINED,  "MOV    M,H",        1,  7,  7) \
+    X(0x75, DEFINED,  "MOV    M,L",        1,  7,  7) \
+    X(0x76, DEFINED,  "HLT",               1,  7,  7) \
+    X(0x77, DEFINED,  "MOV    M,A",        1,  7,  7) \
+    X(0x78, DEFINED,  "MOV    A,B",        1,  5,  5) \
+    X(0x79, DEFINED,  "MOV    A,C",        1,  5,  5) \
+    X(0x7A, DEFINED,  "MOV    A,D",        1,  5,  5) \
+    X(0x7B, DEFINED,  "MOV    A,E",        1,  5,  5) \
+    X(0x7C, DEFINED,  "MOV    A,H",        1,  5,  5) \
+    X(0x7D, DEFINED,  "MOV    A,L",        1,  5,  5) \
+    X(0x7E, DEFINED,  "MOV    A,M",        1,  7,  7) \
+    X(0x7F, DEFINED,  "MOV    A,A",        1,  5,  5) \
+    X(0x80, DEFINED,  "ADD    B",          1,  4,  4) \
+    X(0x81, DEFINED,  "ADD    C",          1,  4,  4) \
+    X(0x82, DEFINED,  "ADD    D",          1,  4,  4) \
+    X(0x83, DEFINED,  "ADD    E",          1,  4,  4) \
+    X(0x84, DEFINED,  "ADD    H",          1,  4,  4) \
+    X(0x85, DEFINED,  "ADD    L",          1,  4,  4) \
+    X(0x86, DEFINED,  "ADD    M",          1,  7,  7) \
+    X(0x87, DEFINED,  "ADD    A",          1,  4,  4) \
+    X(0x88, DEFINED,  "ADC    B",          1,  4,  4) \
+    X(0x89, DEFINED,  "ADC    C",          1,  4,  4) \
+    X(0x8A, DEFINED,  "ADC    D",          1,  4,  4) \
+    X(0x8B, DEFINED,  "ADC    E",          1,  4,  4) \
+    X(0x8C, DEFINED,  "ADC    H",          1,  4,  4) \
+    X(0x8D, DEFINED,  "ADC    L",          1,  4,  4) \
+    X(0x8E, DEFINED,  "ADC    M",          1,  7,  7) \
+    X(0x8F, DEFINED,  "ADC    A",          1,  4,  4) \
+    X(0x90, DEFINED,  "SUB    B",          1,  4,  4) \
+    X(0x91, DEFINED,  "SUB    C",          1,  4,  4) \
+    X(0x92, DEFINED,  "SUB    D",          1,  4,  4) \
+    X(0x93, DEFINED,  "SUB    E",          1,  4,  4) \
+    X(0x94, DEFINED,  "SUB    H",          1,  4,  4) \
+    X(0x95, DEFINED,  "SUB    L",          1,  4,  4) \
+    X(0x96, DEFINED,  "SUB    M",          1,  7,  7) \
+    X(0x97, DEFINED,  "SUB    A",          1,  4,  4) \
+    X(0x98, DEFINED,  "SBB    B",          1,  4,  4) \
+    X(0x99, DEFINED,  "SBB    C",          1,  4,  4) \
+    X(0x9A, DEFINED,  "SBB    D",          1,  4,  4) \
+    X(0x9B, DEFINED,  "SBB    E",          1,  4,  4) \
+    X(0x9C, DEFINED,  "SBB    H",          1,  4,  4) \
+    X(0x9D, DEFINED,  "SBB    L",          1,  4,  4) \
+    X(0x9E, DEFINED,  "SBB    M",          1,  7,  7) \
+    X(0x9F, DEFINED,  "SBB    A",          1,  4,  4) \
+    X(0xA0, DEFINED,  "ANA    B",          1,  4,  4) \
+    X(0xA1, DEFINED,  "ANA    C",          1,  4,  4) \
+    X(0xA2, DEFINED,  "ANA    D",          1,  4,  4) \
+    X(0xA3, DEFINED,  "ANA    E",          1,  4,  4) \
+    X(0xA4, DEFINED,  "ANA    H",          1,  4,  4) \
+    X(0xA5, DEFINED,  "ANA    L",          1,  4,  4) \
+    X(0xA6, DEFINED,  "ANA    M",          1,  7,  7) \
+    X(0xA7, DEFINED,  "ANA    A",          1,  4,  4) \
+    X(0xA8, DEFINED,  "XRA    B",          1,  4,  4) \
+    X(0xA9, DEFINED,  "XRA    C",          1,  4,  4) \
+    X(0xAA, DEFINED,  "XRA    D",          1,  4,  4) \
+    X(0xAB, DEFINED,  "XRA    E",          1,  4,  4) \
+    X(0xAC, DEFINED,  "XRA    H",          1,  4,  4) \
+    X(0xAD, DEFINED,  "XRA    L",          1,  4,  4) \
+    X(0xAE, DEFINED,  "XRA    M",          1,  7,  7) \
+    X(0xAF, DEFINED,  "XRA    A",          1,  4,  4) \
+    X(0xB0, DEFINED,  "ORA    B",          1,  4,  4) \
+    X(0xB1, DEFINED,  "ORA    C",          1,  4,  4) \
+    X(0xB2, DEFINED,  "ORA    D",          1,  4,  4) \
+    X(0xB3, DEFINED,  "ORA    E",          1,  4,  4) \
+    X(0xB4, DEFINED,  "ORA    H",          1,  4,  4) \
+    X(0xB5, DEFINED,  "ORA    L",          1,  4,  4) \
+    X(0xB6, DEFINED,  "ORA    M",          1,  7,  7) \
+    X(0xB7, DEFINED,  "ORA    A",          1,  4,  4) \
+    X(0xB8, DEFINED,  "CMP    B",          1,  4,  4) \
+    X(0xB9, DEFINED,  "CMP    C",          1,  4,  4) \
+    X(0xBA, DEFINED,  "CMP    D",          1,  4,  4) \
+    X(0xBB, DEFINED,  "CMP    E",          1,  4,  4) \
+    X(0xBC, DEFINED,  "CMP    H",          1,  4,  4) \
+    X(0xBD, DEFINED,  "CMP    L",          1,  4,  4) \
+    X(0xBE, DEFINED,  "CMP    M",          1,  7,  7) \
+    X(0xBF, DEFINED,  "CMP    A",          1,  4,  4) \
+    X(0xC0, DEFINED,  "RNZ",               1,  5, 11) \
+    X(0xC1, DEFINED,  "POP    B",          1, 10, 10) \
+    X(0xC2, DEFINED,  "JNZ    $%04X",      3, 10, 10) \
+    X(0xC3, DEFINED,  "JMP    $%04X",      3, 10, 10) \
+    X(0xC4, DEFINED,  "CNZ    $%04X",      3, 11, 17) \
+    X(0xC5, DEFINED,  "PUSH   B",          1, 11, 11) \
+    X(0xC6, DEFINED,  "ADI    #$%02X",     2,  7,  7) \
+    X(0xC7, DEFINED,  "RST    0",          1, 11, 11) \
+    X(0xC8, DEFINED,  "RZ",                1,  5, 11) \
+    X(0xC9, DEFINED,  "RET",               1, 10, 10) \
+    X(0xCA, DEFINED,  "JZ     $%04X",      3, 10, 10) \
+    X(0xCB, UNDEFINED, "*JMP   $%04X",      3, 10, 10) \
+    X(0xCC, DEFINED,  "CZ     $%04X",      3, 11, 17) \
+    X(0xCD, DEFINED,  "CALL   $%04X",      3, 17, 17) \
+    X(0xCE, DEFINED,  "ACI    #$%02X",     2,  7,  7) \
+    X(0xCF, DEFINED,  "RST    1",          1, 11, 11) \
+    X(0xD0, DEFINED,  "RNC",               1,  5, 11) \
+    X(0xD1, DEFINED,  "POP    D",          1, 10, 10) \
+    X(0xD2, DEFINED,  "JNC    $%04X",      3, 10, 10) \
+    X(0xD3, DEFINED,  "OUT    #$%02X",     2, 10, 10) \
+    X(0xD4, DEFINED,  "CNC    $%04X",      3, 11, 17) \
+    X(0xD5, DEFINED,  "PUSH   D",          1, 11, 11) \
+    X(0xD6, DEFINED,  "SUI    #$%02X",     2,  7,  7) \
+    X(0xD7, DEFINED,  "RST    2",          1, 11, 11) \
+    X(0xD8, DEFINED,  "RC",                1,  5, 11) \
+    X(0xD9, UNDEFINED, "*RET",              1, 10, 10) \
+    X(0xDA, DEFINED,  "JC     $%04X",      3, 10, 10) \
+    X(0xDB, DEFINED,  "IN     #$%02X",     2, 10, 10) \
+    X(0xDC, DEFINED,  "CC     $%04X",      3, 11, 17) \
+    X(0xDD, UNDEFINED, "*CALL  $%04X",      3, 17, 17) \
+    X(0xDE, DEFINED,  "SBI    #$%02X",     2,  7,  7) \
+    X(0xDF, DEFINED,  "RST    3",          1, 11, 11) \
+    X(0xE0, DEFINED,  "RPO",               1,  5, 11) \
+    X(0xE1, DEFINED,  "POP    H",          1, 10, 10) \
+    X(0xE2, DEFINED,  "JPO    $%04X",      3, 10, 10) \
+    X(0xE3, DEFINED,  "XTHL",              1, 18, 18) \
+    X(0xE4, DEFINED,  "CPO    $%04X",      3, 11, 17) \
+    X(0xE5, DEFINED,  "PUSH   H",          1, 11, 11) \
+    X(0xE6, DEFINED,  "ANI    #$%02X",     2,  7,  7) \
+    X(0xE7, DEFINED,  "RST    4",          1, 11, 11) \
+    X(0xE8, DEFINED,  "RPE",               1,  5, 11) \
+    X(0xE9, DEFINED,  "PCHL",              1,  5,  5) \
+    X(0xEA, DEFINED,  "JPE    $%04X",      3, 10, 10) \
+    X(0xEB, DEFINED,  "XCHG",              1,  4,  4) \
+    X(0xEC, DEFINED,  "CPE    $%04X",      3, 11, 17) \
+    X(0xED, UNDEFINED, "*CALL  $%04X",      3, 17, 17) \
+    X(0xEE, DEFINED,  "XRI    #$%02X",     2,  7,  7) \
+    X(0xEF, DEFINED,  "RST    5",          1, 11, 11) \
+    X(0xF0, DEFINED,  "RP",                1,  5, 11) \
+    X(0xF1, DEFINED,  "POP    PSW",        1, 10, 10) \
+    X(0xF2, DEFINED,  "JP     $%04X",      3, 10, 10) \
+    X(0xF3, DEFINED,  "DI",                1,  4,  4) \
+    X(0xF4, DEFINED,  "CP     $%04X",      3, 11, 17) \
+    X(0xF5, DEFINED,  "PUSH   PSW",        1, 11, 11) \
+    X(0xF6, DEFINED,  "ORI    #$%02X",     2,  7,  7) \
+    X(0xF7, DEFINED,  "RST    6",          1, 11, 11) \
+    X(0xF8, DEFINED,  "RM",                1,  5, 11) \
+    X(0xF9, DEFINED,  "SPHL",              1,  5,  5) \
+    X(0xFA, DEFINED,  "JM     $%04X",      3, 10, 10) \
+    X(0xFB, DEFINED,  "EI",                1,  4,  4) \
+    X(0xFC, DEFINED,  "CM     $%04X",      3, 11, 17) \
+    X(0xFD, UNDEFINED, "*CALL  $%04X",      3, 17, 17) \
+    X(0xFE, DEFINED,  "CPI    #$%02X",     2,  7,  7) \
+    X(0xFF, DEFINED,  "RST    7",          1, 11, 11)
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include <cpu.h>
+#include <savestate.h>
+
+/*
+ * Machines for runs that start over many times, built once up front.
+ * The template is the state of a machine that ran boot_cycles from power
+ * on; putting a machine back to it copies its RAM and keeps the ROM
+ * image, hooks and the decoded and translated ROM code.
+ */
+typedef struct MachinePool {
+    MachineState template;
+    Cpu8080 **machines;         // every machine of the pool, capacity of them
+    bool *handed_out;           // per entry of machines
+    Cpu8080 **idle;             // stack of machines not handed out
+    unsigned idle_count;
+    unsigned capacity;
+    pthread_mutex_t lock;
+} MachinePool;
+
+/* capacity machines as load_machine() sets them up, the template taken from the first */
+MachinePool* pool_create(unsigned capacity, uint64_t boot_cycles);
+
+/* Every machine must have been released */
+void pool_free(MachinePool *pool);
+
+/* An idle machine reset to the template, or NULL when all are handed out */
+Cpu8080* pool_acquire(MachinePool *pool);
+
+/* cpu must be handed out by pool and not released since; anything else is an error */
+void pool_release(MachinePool *pool, Cpu8080 *cpu);
+
+/* Put a machine handed out by pool back to the template, for a new run without releasing it */
+void pool_reset(const MachinePool *pool, Cpu8080 *cpu);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <cpu.h>
+#include <savestate.h>
+
+/*
+ * One recorded point in the history: the machine state apart from memory,
+ * and where its pages sit in the page ring.
+ */
+typedef struct RewindSnapshot {
+    uint8_t header[offsetof(MachineState, memory)];    // the MachineState up to memory
+    uint64_t first_page;        // position of its first page in the page ring
+    uint16_t page_count;        // MEMORY_PAGE_COUNT for a keyframe
+    bool keyframe;
+} RewindSnapshot;
+
+/*
+ * Rewind history of a fixed size. Every frames_per_snapshot frames it
+ * records a snapshot holding only the pages of memory that changed since
+ * the one before, and every keyframe_interval snapshots a keyframe holding
+ * all of them. Pages go to a ring of page_capacity pages; when it or the
+ * snapshot ring is full the oldest snapshots are dropped, always back to
+ * a keyframe, so memory use is fixed when the buffer is created.
+ *
+ * Going back to a snapshot restores its keyframe and at most
+ * keyframe_interval - 1 deltas.
+ */
+typedef struct RewindBuffer {
+    unsigned frames_per_snapshot;
+    unsigned keyframe_interval;
+    unsigned frame;                 // frames since the newest snapshot
+    unsigned since_keyframe;        // snapshots since the newest keyframe
+
+    RewindSnapshot *snapshots;      // ring of capacity, oldest at first
+    unsigned capacity;
+    unsigned first;
+    unsigned count;
+
+    uint8_t (*pages)[MEMORY_PAGE_SIZE];     // ring of page_capacity
+    uint8_t *page_numbers;                  // page of memory each entry of pages was taken from
+    size_t page_capacity;
+    uint64_t page_head;             // positions only grow, the ring index is position % page_capacity
+    uint64_t page_tail;             // first position still in use
+
+    MachineState state;             // staging for save_state()/load_state()
+    uint8_t reference[TOTAL_MEMORY_SIZE];   // memory as of the newest snapshot
+} RewindBuffer;
+
+/* page_capacity must hold at least two keyframes, 2 * MEMORY_PAGE_COUNT */
+RewindBuffer* rewind_create(unsigned capacity, unsigned frames_per_snapshot, unsigned keyframe_interval, size_t page_capacity);
+void rewind_free(RewindBuffer *buffer);
+
+/* Call once per emulated frame; records a snapshot every frames_per_snapshot calls */
+void rewind_record_frame(RewindBuffer *buffer, const Cpu8080 *cpu);
+
+/*
+ * Put cpu back to the snapshot steps before the newest (0 is the newest)
+ * and forget the snapshots after it, so recording carries on from there.
+ * Returns false when the history is not that deep or the state does not
+ * load (see load_state()).
+ */
+bool rewind_step_back(RewindBuffer *buffer, Cpu8080 *cpu, unsigned steps);
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef ROM_H
 #define ROM_H
 
+#include <memory_map.h>
+
 #define ROM_SPACE_INVADERS "./rom/invaders.b"
 
 #define ROM_8080PRE "./rom/cpu_tests/8080PRE.COM"
@@ -9,7 +11,33 @@
 
 #define ROM_FILE ROM_SPACE_INVADERS
 
+/*
+ * Where the image is placed in memory and whether the arcade memory map
+ * (write-protected ROM, mirrored RAM) applies: 0x0000 and 1 for the arcade
+ * ROM, 0x0100 and 0 for CP/M .COM programs, which run in flat RAM.
+ */
+#define ROM_LOAD_ADDRESS 0x0000
+#define ROM_ARCADE_MAP 1
+
+/*
+ * ROM_FILE as loaded once for the whole process, split in pages from
+ * ROM_LOAD_ADDRESS (the last one zero padded). Machines map the pages
+ * rather than copying them; read-only once loaded.
+ */
+typedef struct RomImage {
+    unsigned users;             // machines holding the image, under the store's lock
+    unsigned size;
+    unsigned page_count;
+    SharedPage *pages[MEMORY_PAGE_COUNT];
+} RomImage;
+
 char* get_rom();
 int get_rom_size();
 
-#endif
\ No newline at end of file
+/* The process' ROM image, loaded by the first call; NULL if it cannot be read */
+const RomImage* acquire_rom();
+
+/* Drop a reference from acquire_rom(), freeing the image with the last one; NULL is ignored */
+void release_rom(const RomImage *image);
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <cpu.h>
+
+#define MACHINE_STATE_MAGIC   0x30383038u   // "8080" little-endian
+#define MACHINE_STATE_VERSION 1
+
+/*
+ * Everything about a machine that changes while it runs, flat and without
+ * pointers, so a state can be copied, written out or compared byte for
+ * byte. The caller owns the storage; saving and loading are a few copies
+ * with no allocation.
+ *
+ * The machine's configuration is not part of it: ROM, memory map, hooks
+ * and breakpoints stay as they are in the machine a state is loaded into.
+ */
+typedef struct MachineState {
+    uint32_t magic;
+    uint32_t version;
+
+    uint64_t cycles;
+    uint64_t event_deadline[EVENT_COUNT];   // UINT64_MAX when not scheduled
+    uint64_t event_period[EVENT_COUNT];
+
+    uint32_t pc;
+    uint16_t sp;
+    uint8_t B, C, D, E, H, L, A, F;
+    LazyFlags lazy;                         // pending flag record, FLAGS_* values are part of the format
+    uint8_t interrupt_enabled;
+    uint8_t halted;
+    uint8_t io_data[7];                     // port latches and the shift register
+
+    _Alignas(CACHE_LINE_SIZE) uint8_t memory[TOTAL_MEMORY_SIZE];   // RAM and ROM pages, zero under mirrors and MMIO
+} MachineState;
+
+/* Copy cpu's state into state */
+void save_state(const Cpu8080 *cpu, MachineState *state);
+
+/*
+ * Put cpu back in a state saved from a machine with the same ROM and
+ * memory map; ROM pages mapped from the ROM image are kept, and a machine
+ * an unimplemented opcode stopped runs again. Returns false, leaving cpu
+ * untouched, when state is not a MACHINE_STATE_VERSION state or schedules
+ * an event cpu has no handler for.
+ */
+bool load_state(Cpu8080 *cpu, const MachineState *state);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct Cpu8080;
+
+/* Event sources; events due at the same cycle run in this order */
+typedef enum EventId {
+    EVENT_MID_SCREEN,       // beam at the middle of the screen, RST 1
+    EVENT_VBLANK,           // start of vertical blank, RST 2
+    EVENT_COUNT
+} EventId;
+
+typedef void (*EventHandler)(struct Cpu8080 *cpu);
+
+typedef struct Event {
+    uint64_t deadline;      // cycle count at which the event is due
+    uint64_t period;        // re-armed this many cycles later, 0 for one-shot
+    EventHandler handler;   // NULL while not scheduled
+} Event;
+
+/*
+ * Pending events keyed on cpu->cycles. The run loops only compare against
+ * next, once per instruction or block, and call scheduler_run() when it
+ * has been reached.
+ */
+typedef struct Scheduler {
+    uint64_t next;          // earliest deadline, UINT64_MAX when nothing is scheduled
+    Event events[EVENT_COUNT];
+} Scheduler;
+
+void scheduler_init(Scheduler *scheduler);
+void scheduler_add(Scheduler *scheduler, EventId id, uint64_t deadline, uint64_t period, EventHandler handler);
+void scheduler_cancel(Scheduler *scheduler, EventId id);
+
+/* Run every event due at or before now, earliest first */
+void scheduler_run(Scheduler *scheduler, struct Cpu8080 *cpu, uint64_t now);
+
+#endif
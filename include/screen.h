@@ -1,15 +1,26 @@
 #ifndef SCREEN_H
 #define SCREEN_H
 
+#include <SDL2/SDL.h>
+
 #include <cpu.h>
 
-void create_window();
-void create_render();
-void create_texture();
-void init_sdl_screen_buffer();
-void update_screen();
-void finish_and_free(Cpu8080 *cpu);
-void buffer_to_screen(Cpu8080 *cpu);
-void init_screen();
+/* One window showing one machine's frame buffer */
+typedef struct Screen {
+    SDL_Window *window;
+    SDL_Renderer *renderer;
+    SDL_Texture *texture;
+    SDL_PixelFormat *format;
+    Uint32 buffer[VIDEO_RAM_SIZE * 8];
+} Screen;
+
+void create_window(Screen *screen);
+void create_render(Screen *screen);
+void create_texture(Screen *screen);
+void init_sdl_screen_buffer(Screen *screen);
+void update_screen(Screen *screen);
+void free_screen(Screen *screen);
+void buffer_to_screen(Screen *screen, Cpu8080 *cpu);
+Screen* init_screen();
 
 #endif
\ No newline at end of file
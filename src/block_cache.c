@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <block_cache.h>
+#include <cpu.h>
+
+BlockCache* block_cache_create()
+{
+    BlockCache *cache = (BlockCache*)calloc(1, sizeof(BlockCache));
+
+    if (!cache) {
+        fprintf(stderr, "Error allocating block cache: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    return cache;
+}
+
+void block_cache_free(BlockCache *cache)
+{
+    free(cache);
+}
+
+static inline Block* block_slot(BlockCache *cache, uint16_t pc)
+{
+    return &cache->blocks[pc & (BLOCK_CACHE_SIZE - 1)];
+}
+
+static inline uint8_t first_page(const Block *block)
+{
+    return block->start >> BLOCK_PAGE_SHIFT;
+}
+
+static inline uint8_t last_page(const Block *block)
+{
+    return (uint16_t)(block->start + block->size - 1) >> BLOCK_PAGE_SHIFT;
+}
+
+static void block_track(BlockCache *cache, const Block *block, int delta)
+{
+    cache->code_pages[first_page(block)] += delta;
+
+    if (last_page(block) != first_page(block))
+        cache->code_pages[last_page(block)] += delta;
+
+    for (uint16_t offset = 0; offset < block->size; offset++)
+        cache->code_bytes[(uint16_t)(block->start + offset)] += delta;
+}
+
+static void block_evict(BlockCache *cache, Block *block)
+{
+    if (block->count == 0)
+        return;
+
+    block_track(cache, block, -1);
+    block->count = 0;
+}
+
+/* Instructions after which the next PC or the interrupt state is only known at run time */
+bool ends_block(uint8_t opcode)
+{
+    switch (opcode)
+    {
+        case 0x76:                                      /* HLT */
+        case 0xC3: case 0xE9:                           /* JMP, PCHL */
+        case 0xCD: case 0xC9:                           /* CALL, RET */
+        case 0xD3: case 0xDB:                           /* OUT, IN */
+        case 0xF3: case 0xFB:                           /* DI, EI */
+            return true;
+    }
+
+    /* Jcc, Ccc, Rcc and RST */
+    switch (opcode & 0xC7)
+    {
+        case 0xC0: case 0xC2: case 0xC4: case 0xC7:
+            return true;
+    }
+
+    return false;
+}
+
+/* Instructions that change memory or the stack, which a busy-wait loop never does */
+static bool stores(uint8_t opcode)
+{
+    switch (opcode)
+    {
+        case 0x02: case 0x12:                           /* STAX B, STAX D */
+        case 0x22: case 0x32:                           /* SHLD, STA */
+        case 0x34: case 0x35: case 0x36:                /* INR M, DCR M, MVI M */
+        case 0xC5: case 0xD5: case 0xE5: case 0xF5:     /* PUSH */
+        case 0xC1: case 0xD1: case 0xE1: case 0xF1:     /* POP */
+        case 0xE3: case 0xF9:                           /* XTHL, SPHL */
+            return true;
+    }
+
+    /* Ccc and RST push a return address */
+    if ((opcode & 0xC7) == 0xC4 || (opcode & 0xC7) == 0xC7)
+        return true;
+
+    /* MOV M,r */
+    return opcode >= 0x70 && opcode < 0x78 && opcode != 0x76;
+}
+
+/* JMP or Jcc */
+static inline bool is_jump(uint8_t opcode)
+{
+    return opcode == 0xC3 || (opcode & 0xC7) == 0xC2;
+}
+
+static const uint8_t SUPERINSTRUCTION_PAIRS[SUPER_COUNT][2] = {
+    [SUPER_DCR_B_JNZ]       = { 0x05, 0xC2 },
+    [SUPER_ANA_A_JNZ]       = { 0xA7, 0xC2 },
+    [SUPER_ANA_A_JZ]        = { 0xA7, 0xCA },
+    [SUPER_MOV_A_M_ANA_A]   = { 0x7E, 0xA7 },
+    [SUPER_MOV_A_M_INX_H]   = { 0x7E, 0x23 },
+    [SUPER_INX_H_DCR_B]     = { 0x23, 0x05 },
+    [SUPER_INX_H_INX_D]     = { 0x23, 0x13 },
+    [SUPER_LDA_ANA_A]       = { 0x3A, 0xA7 },
+    [SUPER_LDA_CPI]         = { 0x3A, 0xFE },
+    [SUPER_MOV_M_A_INX_H]   = { 0x77, 0x23 },
+    [SUPER_LDAX_D_MOV_M_A]  = { 0x1A, 0x77 },
+};
+
+static int superinstruction(uint8_t first, uint8_t second)
+{
+    for (int super = 0; super < SUPER_COUNT; super++)
+    {
+        if (SUPERINSTRUCTION_PAIRS[super][0] == first && SUPERINSTRUCTION_PAIRS[super][1] == second)
+            return super;
+    }
+
+    return -1;
+}
+
+/*
+ * Pair from the end, so a closing Jcc goes with the instruction that sets
+ * its flag rather than being left over by an earlier pair.
+ */
+static void fuse_pairs(Block *block, const void *const *handlers)
+{
+    for (int i = block->count - 2; i >= 0; i--)
+    {
+        int super = superinstruction(block->ops[i].opcode, block->ops[i + 1].opcode);
+
+        if (super >= 0)
+        {
+            block->ops[i].handler = handlers[256 + super];
+            i--;
+        }
+    }
+}
+
+static const struct {
+    Idiom idiom;
+    uint8_t count;
+    uint8_t opcodes[6];
+} IDIOM_SHAPES[] = {
+    { IDIOM_COPY,           6, { 0x1A, 0x77, 0x23, 0x13, 0x05, 0xC2 } },
+    { IDIOM_FILL,           4, { 0x77, 0x23, 0x05, 0xC2 } },
+    { IDIOM_FILL_IMMEDIATE, 4, { 0x36, 0x23, 0x05, 0xC2 } },
+    { IDIOM_FILL_TO_H,      5, { 0x36, 0x23, 0x7C, 0xFE, 0xC2 } },
+    { IDIOM_COMPARE,        3, { 0x1A, 0xBE, 0xC2 } },
+};
+
+/* The loop tail after a compare head, as its bytes sit in guest memory */
+bool idiom_compare_tail(const uint8_t tail[IDIOM_COMPARE_TAIL_SIZE], uint16_t head)
+{
+    return tail[0] == 0x23 && tail[1] == 0x13 && tail[2] == 0x05 && tail[3] == 0xC2 &&
+           tail[4] == (head & 0xFF) && tail[5] == (head >> 8);
+}
+
+static Idiom match_idiom(const Block *block, const MemoryMap *map)
+{
+    const MicroOp *last = &block->ops[block->count - 1];
+
+    for (unsigned shape = 0; shape < sizeof(IDIOM_SHAPES) / sizeof(IDIOM_SHAPES[0]); shape++)
+    {
+        if (IDIOM_SHAPES[shape].count != block->count)
+            continue;
+
+        unsigned i = 0;
+
+        while (i < block->count && block->ops[i].opcode == IDIOM_SHAPES[shape].opcodes[i])
+            i++;
+
+        if (i < block->count)
+            continue;
+
+        if (IDIOM_SHAPES[shape].idiom != IDIOM_COMPARE)
+            return last->operand == block->start ? IDIOM_SHAPES[shape].idiom : IDIOM_NONE;
+
+        // the tail is another block, run_idiom() checks it again before each use
+        uint16_t tail = block->start + block->size;
+        uint8_t bytes[IDIOM_COMPARE_TAIL_SIZE];
+
+        for (unsigned byte = 0; byte < IDIOM_COMPARE_TAIL_SIZE; byte++)
+        {
+            if (!page_is_direct(map, tail + byte))
+                return IDIOM_NONE;
+
+            bytes[byte] = direct_byte(map, tail + byte);
+        }
+
+        return idiom_compare_tail(bytes, block->start) ? IDIOM_COMPARE : IDIOM_NONE;
+    }
+
+    return IDIOM_NONE;
+}
+
+Block* block_cache_lookup(BlockCache *cache, uint16_t pc)
+{
+    Block *block = block_slot(cache, pc);
+
+    if (block->count == 0 || block->start != pc)
+        return NULL;
+
+    return block;
+}
+
+Block* block_cache_decode(BlockCache *cache, const MemoryMap *map, uint16_t pc, const void *const *handlers)
+{
+    Block *block = block_slot(cache, pc);
+    uint16_t address = pc;
+    uint16_t cycles = 0;
+    uint8_t count = 0;
+    bool pure = true;
+
+    block_evict(cache, block);
+
+    while (count < BLOCK_MAX_OPS)
+    {
+        if (!page_is_direct(map, address))
+            break;
+
+        uint8_t opcode = direct_byte(map, address);
+        uint8_t length = INSTRUCTION_LENGTH[opcode];
+
+        if (INSTRUCTION_UNDEFINED[opcode] || !page_is_direct(map, address + length - 1))
+            break;
+
+        MicroOp *op = &block->ops[count++];
+
+        op->opcode = opcode;
+        op->handler = handlers ? handlers[opcode] : NULL;
+        op->operand = 0;
+
+        if (length == 2)
+            op->operand = direct_byte(map, address + 1);
+        else if (length == 3)
+            op->operand = twoU8_to_u16value(direct_byte(map, address + 2), direct_byte(map, address + 1));
+
+        cycles += INSTRUCTION_CYCLES[opcode];
+        address += length;
+        pure = pure && !stores(opcode);
+
+        if (ends_block(opcode))
+            break;
+    }
+
+    if (count == 0)
+        return NULL;
+
+    block->start = pc;
+    block->size = (uint16_t)(address - pc);
+    block->cycles = cycles;
+    block->taken_cycles = cycles - INSTRUCTION_CYCLES[block->ops[count - 1].opcode] +
+                          INSTRUCTION_CYCLES_TAKEN[block->ops[count - 1].opcode];
+    block->count = count;
+    block->hits = 0;
+
+    const MicroOp *last = &block->ops[count - 1];
+    block->spin = pure && is_jump(last->opcode) && last->operand == pc;
+    block->idiom = match_idiom(block, map);
+
+    if (handlers)
+        fuse_pairs(block, handlers);
+
+    block_track(cache, block, +1);
+
+    return block;
+}
+
+void block_cache_invalidate(BlockCache *cache, uint16_t address)
+{
+    // a block covering address starts at most BLOCK_MAX_SIZE - 1 bytes before it
+    for (uint16_t back = 0; back < BLOCK_MAX_SIZE && cache->code_bytes[address]; back++)
+    {
+        Block *block = block_cache_lookup(cache, address - back);
+
+        if (block && (uint16_t)(address - block->start) < block->size)
+            block_evict(cache, block);
+    }
+}
+
+void block_cache_invalidate_page(BlockCache *cache, uint8_t page)
+{
+    for (unsigned index = 0; index < BLOCK_CACHE_SIZE && cache->code_pages[page]; index++)
+    {
+        Block *block = &cache->blocks[index];
+
+        if (block->count != 0 && (first_page(block) == page || last_page(block) == page))
+            block_evict(cache, block);
+    }
+}
@@ -1,85 +1,187 @@
 #include <stdint.h>
 #include <stdio.h>
-#include <SDL2/SDL.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 #include <errno.h>
 #include <unistd.h>
 #include <sys/types.h>
 
 #include <cpu.h>
+#include <bus.h>
 #include <helper.h>
 #include <debug.h>
 #include <rom.h>
-#include <screen.h>
 #include <main.h>
 
+#ifndef HEADLESS
+#include <SDL2/SDL.h>
+#include <screen.h>
+#endif
+
+#ifdef AOT_ROM
+#include <aot.h>
+#endif
+
+static void schedule_video_interrupts(Cpu8080 *cpu);
+static uint64_t execute_block(Cpu8080 *cpu, const Block *block);
+
 // #define print_opcode printf
-unsigned int rom_size;
-int8_t error_occurred = -1;
-
-// Global alias
-uint8_t* A;
-uint8_t* B;
-uint8_t* C;
-uint8_t* D;
-uint8_t* E;
-uint8_t* H;
-uint8_t* L;
+
+uint8_t szp_flags[256];
+
+/* A after DAA in the low byte and the resulting F in the high byte, indexed by A | CY << 8 | AC << 9 */
+static uint16_t daa_table[1024];
+
+/*
+ * AC of an 8-bit add or subtract from bit 3 of both operands and the
+ * result, by instruction class. The 8080 subtracts by adding the
+ * complement, so for SUB the flag means no borrow out of the low nibble.
+ */
+#define HALF_CARRY_INDEX(lhs, rhs, result) \
+	((((lhs) & 0x08) >> 1) | (((rhs) & 0x08) >> 2) | (((result) & 0x08) >> 3))
+
+static const uint8_t half_carry[][8] = {
+	[FLAGS_ADD] = { 0, 0, FLAG_AUX_CARRY, 0, FLAG_AUX_CARRY, 0, FLAG_AUX_CARRY, FLAG_AUX_CARRY },
+	[FLAGS_SUB] = { FLAG_AUX_CARRY, 0, 0, 0, FLAG_AUX_CARRY, FLAG_AUX_CARRY, FLAG_AUX_CARRY, 0 },
+	// ANA sets AC from bit 3 of either operand
+	[FLAGS_AND] = { 0, 0, FLAG_AUX_CARRY, FLAG_AUX_CARRY, FLAG_AUX_CARRY, FLAG_AUX_CARRY, FLAG_AUX_CARRY, FLAG_AUX_CARRY },
+	[FLAGS_OR]  = { 0 },
+};
+
+static void build_flag_tables(void)
+{
+	for (int value = 0; value < 256; value++)
+	{
+		int bits = 0;
+
+		for (int bit = 0; bit < 8; bit++)
+			bits += (value >> bit) & 1;
+
+		szp_flags[value] = (value == 0 ? FLAG_ZERO : 0) |
+						   (value & 0x80 ? FLAG_SIGN : 0) |
+						   (bits % 2 == 0 ? FLAG_PARITY : 0);
+	}
+
+	for (int index = 0; index < 1024; index++)
+	{
+		uint8_t a = index & 0xFF;
+		uint8_t fourLSB = a & 0x0F;
+		uint8_t fourMSB = a >> 4;
+		uint8_t correction = 0;
+		uint8_t carry = (index >> 8) & 1;
+
+		if ((fourLSB > 0x09) || (index >> 9))
+			correction |= 0x06;
+
+		if ((fourMSB > 0x09) || carry || (fourMSB >= 0x09 && fourLSB > 0x09))
+		{
+			correction |= 0x60;
+			carry = 1;
+		}
+
+		uint8_t result = a + correction;
+		uint8_t flags = FLAG_ALWAYS_ONE | szp_flags[result] | (carry ? FLAG_CARRY : 0) |
+						half_carry[FLAGS_ADD][HALF_CARRY_INDEX(a, correction, result)];
+
+		daa_table[index] = (uint16_t)(flags << 8 | result);
+	}
+}
+
+/* Tables shared by every instance; written once, read-only afterwards */
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void build_tables()
+{
+	build_flag_tables();
+	execute_block(NULL, NULL);
+}
 
 Cpu8080* init_cpu() 
 {
-	Cpu8080 *cpu = (Cpu8080*)malloc(sizeof(Cpu8080));
+	pthread_once(&tables_once, build_tables);
+
+	// the guest memory is part of the instance, see Cpu8080
+	Cpu8080 *cpu = (Cpu8080*)aligned_alloc(_Alignof(Cpu8080), sizeof(Cpu8080));
 
 	if (!cpu) {
 		fprintf(stderr, "Error allocating memory for CPU: %s\n", strerror(errno));
 		exit(EXIT_FAILURE);
 	}
 
-	cpu->memory = (uint8_t*)calloc(TOTAL_MEMORY_SIZE, sizeof(uint8_t));
+	memset(cpu->memory, 0, sizeof(cpu->memory));
+	memory_map_init(&cpu->memory_map, cpu->memory);
 
-	if (! cpu->memory) {
-		fprintf(stderr, "Error on memory allocation: %s\n", strerror(errno));
-		exit(EXIT_FAILURE);
-	}
-
-	A = &cpu->registers.A;
-	B = &cpu->registers.B;
-	C = &cpu->registers.C;
-	D = &cpu->registers.D;
-	E = &cpu->registers.E;
-	H = &cpu->registers.H;
-	L = &cpu->registers.L;
+	cpu->registers.BC = 0;
+	cpu->registers.DE = 0;
+	cpu->registers.HL = 0;
 
 	cpu->registers.A = 0;
-	cpu->registers.B = 0;
-	cpu->registers.C = 0;
-	cpu->registers.D = 0;
-	cpu->registers.E = 0;
-	cpu->registers.H = 0;
-	cpu->registers.L = 0;
-
-	cpu->registers.F.cy = 0;
-	cpu->registers.F.p  = 0;
-	cpu->registers.F.ac = 0;
-	cpu->registers.F.z  = 0;
-	cpu->registers.F.s  = 0;
+	cpu->registers.F = FLAG_ALWAYS_ONE;
+	cpu->registers.lazy.op = FLAGS_RESOLVED;
 
 	cpu->registers.sp = 0x2400;
 	cpu->registers.pc = 0x00;
 
 	cpu->interrupt_enabled = false;
+	cpu->halted = false;
+	cpu->cycles = 0;
+	cpu->block_cache = NULL;
+	cpu->jit = NULL;
+	cpu->breakpoints = NULL;
+	cpu->breakpoint_count = 0;
+	cpu->hook_bitmap = NULL;
+	cpu->hooks = NULL;
+	cpu->hook_count = 0;
+	cpu->pair_counts = NULL;
+	cpu->rom = NULL;
+	cpu->error_occurred = -1;
+	memset(cpu->io_data, 0, sizeof(cpu->io_data));
+
+	scheduler_init(&cpu->scheduler);
+	schedule_video_interrupts(cpu);
+
+#if PAIR_PROFILE
+	cpu->pair_counts = (uint64_t*)calloc(0x10000, sizeof(uint64_t));
+
+	if (! cpu->pair_counts) {
+		fprintf(stderr, "Error allocating pair profile: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+#endif
 	
 	return cpu;
 }
 
-uint8_t io_data[7];
+void free_cpu(Cpu8080 *cpu)
+{
+	if (!cpu)
+		return;
+
+	memory_map_release(&cpu->memory_map);
+	release_rom(cpu->rom);
+	block_cache_free(cpu->block_cache);
+	jit_free(cpu->jit);
+	free(cpu->breakpoints);
+	free(cpu->hook_bitmap);
+	free(cpu->hooks);
 
-uint8_t io_read(uint8_t port) 
+	if (cpu->pair_counts)
+	{
+		print_pair_profile(cpu->pair_counts, PAIR_PROFILE_TOP);
+		free(cpu->pair_counts);
+	}
+
+	free(cpu);
+}
+
+uint8_t io_read(Cpu8080 *cpu, uint8_t port) 
 {
 	uint8_t value = 0x00;
     switch (port) 
     {
     	case SHIFTER_IN:
-        	value = io_data[SHIFTER_IN];
+        	value = cpu->io_data[SHIFTER_IN];
     	break;
     }
 
@@ -91,343 +193,279 @@ void io_write(Cpu8080 *cpu, uint8_t port)
 	switch(port)
 	{
 		case SHIFTER_BITS_OUT:
-			io_data[SHIFTER_BITS_OUT] = cpu->registers.A & 0x07;
+			cpu->io_data[SHIFTER_BITS_OUT] = cpu->registers.A & 0x07;
 			break;
 
 		case SHIFTER_VALUE_OUT:
 		{
-			io_data[SHIFTER_PREV_VALUE] = io_data[SHIFTER_VALUE_OUT];
-			io_data[SHIFTER_VALUE_OUT] = cpu->registers.A;
+			cpu->io_data[SHIFTER_PREV_VALUE] = cpu->io_data[SHIFTER_VALUE_OUT];
+			cpu->io_data[SHIFTER_VALUE_OUT] = cpu->registers.A;
 			break;
 		}
 	}
 }
 
-static inline void external_dev_routine()
+static inline void external_dev_routine(Cpu8080 *cpu)
 {
 	/* Shifter */
-	uint8_t ammnt = io_data[SHIFTER_BITS_OUT];
-	uint8_t value = io_data[SHIFTER_VALUE_OUT];
-
-	io_data[SHIFTER_IN] = value << ammnt;
-}
-
-int parity(int x, int size)
-{
-	int parity = 0;
+	uint8_t ammnt = cpu->io_data[SHIFTER_BITS_OUT];
+	uint8_t value = cpu->io_data[SHIFTER_VALUE_OUT];
 
-	int i;
-	for (i = 0; i < size; i++)
-	{
-		parity += x & 1;
-		x = x >> 1;
-	}
-	return (parity % 2 == 0);
+	cpu->io_data[SHIFTER_IN] = value << ammnt;
 }
 
-void LogicFlagsA(Cpu8080 *cpu)
+/*
+ * Lazy flags.
+ *
+ * ALU instructions only set CY and record their operands and result in
+ * registers.lazy; Z, S, P and AC are worked out from that record when a
+ * conditional instruction, PUSH PSW or DAA reads them, and before code
+ * outside the interpreter (translated blocks) sees registers.F. Most
+ * results are overwritten by the next ALU instruction long before then.
+ */
+static inline void defer_flags(Cpu8080 *cpu, uint8_t op, uint8_t lhs, uint8_t rhs, uint8_t result)
 {
-	cpu->registers.F.cy = cpu->registers.F.ac = 0;
-	cpu->registers.F.z = (cpu->registers.A == 0);
-	cpu->registers.F.s = (0x80 == (cpu->registers.A & 0x80));
-	cpu->registers.F.p = parity(cpu->registers.A, 8);
+	cpu->registers.lazy.op = op;
+	cpu->registers.lazy.lhs = lhs;
+	cpu->registers.lazy.rhs = rhs;
+	cpu->registers.lazy.result = result;
 }
 
-void ArithFlagsA(Cpu8080 *cpu, uint16_t res)
+static inline void resolve_flags(Cpu8080 *cpu)
 {
-	cpu->registers.F.cy = (res > 0xff);
-	cpu->registers.F.z = ((res&0xff) == 0);
-	cpu->registers.F.s = (0x80 == (res & 0x80));
-	cpu->registers.F.p = parity(res&0xff, 8);
-	cpu->registers.F.ac = (res > 0x09);
-}
+	LazyFlags *lazy = &cpu->registers.lazy;
 
-void BcdArithFlags(Cpu8080 *cpu, uint16_t res)
-{
-	cpu->registers.F.cy = (res > 0xff);
-	cpu->registers.F.z = ((res & 0xff) == 0);
-	cpu->registers.F.s = (0x80 == (res & 0x80));
-	cpu->registers.F.p = parity(res & 0xff, 8);
-	cpu->registers.F.ac = (res > 0x09);
-}
+	if (lazy->op == FLAGS_RESOLVED)
+		return;
 
-void NOP(Cpu8080 *cpu) 
-{
-	cpu->registers.pc++;
-	return;
-}
+	cpu->registers.F = (cpu->registers.F & FLAG_CARRY) | FLAG_ALWAYS_ONE | szp_flags[lazy->result] |
+					   half_carry[lazy->op][HALF_CARRY_INDEX(lazy->lhs, lazy->rhs, lazy->result)];
 
-void LXI(Cpu8080 *cpu, uint8_t *msgReg, uint8_t *lsbReg) 
-{
-	*lsbReg = cpu->memory[cpu->registers.pc + 1];
-	*msgReg = cpu->memory[cpu->registers.pc + 2];
-	cpu->registers.pc += 3;
+	lazy->op = FLAGS_RESOLVED;
 }
 
-void LDA(Cpu8080 *cpu)
+static inline bool zero_flag(Cpu8080 *cpu)
 {
-	uint16_t address = read_byte_address(cpu);
-	cpu->registers.A = cpu->memory[address];
+	if (cpu->registers.lazy.op != FLAGS_RESOLVED)
+		return cpu->registers.lazy.result == 0;
 
-	cpu->registers.pc += 3;
+	return cpu->registers.F & FLAG_ZERO;
 }
 
-void LDAX(Cpu8080 *cpu, uint8_t *msbReg, uint8_t *lsbReg)
+static inline bool sign_flag(Cpu8080 *cpu)
 {
-	uint16_t address = (*msbReg << 8) | *lsbReg;
-
-	cpu->registers.A = cpu->memory[address];
+	if (cpu->registers.lazy.op != FLAGS_RESOLVED)
+		return cpu->registers.lazy.result >> 7;
 
-	cpu->registers.pc++;
-}
-
-void STAX(Cpu8080 *cpu, uint8_t *_register1, uint8_t *_register2)
-{
-	uint16_t adress = (*_register1 << 8) | *_register2;
-	cpu->memory[adress] = cpu->registers.A;
-	
-	cpu->registers.pc++;
+	return cpu->registers.F & FLAG_SIGN;
 }
 
-void STA(Cpu8080 *cpu)
+static inline bool parity_flag(Cpu8080 *cpu)
 {
-	uint16_t address = read_byte_address(cpu);
+	if (cpu->registers.lazy.op != FLAGS_RESOLVED)
+		return szp_flags[cpu->registers.lazy.result] & FLAG_PARITY;
 
-	cpu->memory[address] = cpu->registers.A;
-	cpu->registers.pc += 3;
+	return cpu->registers.F & FLAG_PARITY;
 }
 
-void STC(Cpu8080 *cpu)
+static inline bool carry_flag(Cpu8080 *cpu)
 {
-	cpu->registers.F.cy = 1;
-	cpu->registers.pc++;
+	return cpu->registers.F & FLAG_CARRY;
 }
 
-void ADC(Cpu8080 *cpu, uint8_t value)
+static inline void set_carry(Cpu8080 *cpu, bool carry)
 {
-	uint16_t result16 = (uint16_t)value + (uint16_t)cpu->registers.A + (uint16_t)cpu->registers.F.cy;
-
-	BcdArithFlags(cpu, result16);
-
-	cpu->registers.A = result16 & 0xFF;
-
-	cpu->registers.pc++;
+	cpu->registers.F = (cpu->registers.F & ~FLAG_CARRY) | carry;
 }
 
-void ACI(Cpu8080 *cpu)
+/* lhs + rhs + carry, setting CY and deferring the rest */
+static inline uint8_t add_byte(Cpu8080 *cpu, uint8_t lhs, uint8_t rhs, uint8_t carry)
 {
-	uint8_t value = read_byte(cpu);
-
-	uint16_t result16 = value + cpu->registers.A + (cpu->registers.F.cy);
+	uint16_t result16 = (uint16_t)lhs + (uint16_t)rhs + carry;
 
-	BcdArithFlags(cpu, result16);
+	set_carry(cpu, result16 > 0xFF);
+	defer_flags(cpu, FLAGS_ADD, lhs, rhs, result16 & 0xFF);
 
-	cpu->registers.A = result16 & 0xFF;
-
-	cpu->registers.pc += 2;
+	return result16 & 0xFF;
 }
 
-void SBI(Cpu8080 *cpu)
+/* lhs - rhs - borrow, setting CY and deferring the rest */
+static inline uint8_t sub_byte(Cpu8080 *cpu, uint8_t lhs, uint8_t rhs, uint8_t borrow)
 {
-	uint8_t value = read_byte(cpu);
+	uint16_t result16 = (uint16_t)lhs - (uint16_t)rhs - borrow;
 
-	uint16_t result16 = cpu->registers.A - value - (cpu->registers.F.cy);
+	set_carry(cpu, result16 > 0xFF);
+	defer_flags(cpu, FLAGS_SUB, lhs, rhs, result16 & 0xFF);
 
-	BcdArithFlags(cpu, result16);
-
-	cpu->registers.A = result16 & 0xFF;
-
-	cpu->registers.pc += 2;
+	return result16 & 0xFF;
 }
 
-void SUI(Cpu8080 *cpu)
+/* ANA, XRA and ORA clear CY */
+static inline uint8_t logic_byte(Cpu8080 *cpu, uint8_t op, uint8_t lhs, uint8_t rhs, uint8_t result)
 {
-	uint8_t value = read_byte(cpu);
-	uint16_t result16 = cpu->registers.A - value;
-
-	uint8_t old_A = cpu->registers.A;
+	set_carry(cpu, false);
+	defer_flags(cpu, op, lhs, rhs, result);
 
-	cpu->registers.A = result16 & 0xFF;
-
-	ArithFlagsA(cpu, result16);
-	cpu->registers.F.cy = 0;
-	if (cpu->registers.A >= old_A)
-		cpu->registers.F.cy = 1;
-
-	cpu->registers.pc+=2;
+	return result;
 }
 
-void SUB(Cpu8080 *cpu, uint8_t value)
-{
-	uint16_t result16 = (uint16_t)cpu->registers.A - (uint16_t)value;
-
-	BcdArithFlags(cpu, result16);
+/*
+ * Register field of the MOV, MVI, INR, DCR and ALU opcodes: B, C, D, E, H,
+ * L, M (the byte at HL) or A. Handlers name their operand through these
+ * rather than a pointer, so every one is compiled for its own register.
+ */
+#define LOAD_B				cpu->registers.B
+#define LOAD_C				cpu->registers.C
+#define LOAD_D				cpu->registers.D
+#define LOAD_E				cpu->registers.E
+#define LOAD_H				cpu->registers.H
+#define LOAD_L				cpu->registers.L
+#define LOAD_M				read_memory(cpu, HL_ADDRESS)
+#define LOAD_A				cpu->registers.A
 
-	cpu->registers.F.ac = cpu->registers.A< (value & 0x0F);
+#define STORE_B(value)		cpu->registers.B = (value)
+#define STORE_C(value)		cpu->registers.C = (value)
+#define STORE_D(value)		cpu->registers.D = (value)
+#define STORE_E(value)		cpu->registers.E = (value)
+#define STORE_H(value)		cpu->registers.H = (value)
+#define STORE_L(value)		cpu->registers.L = (value)
+#define STORE_M(value)		write_memory(cpu, HL_ADDRESS, (value))
+#define STORE_A(value)		cpu->registers.A = (value)
 
-	cpu->registers.A = result16 & 0xFF;
+/* How a handler writing the field carries on: only M stores to memory, which may hold code being run */
+#define DISPATCH_AFTER_B()	DISPATCH()
+#define DISPATCH_AFTER_C()	DISPATCH()
+#define DISPATCH_AFTER_D()	DISPATCH()
+#define DISPATCH_AFTER_E()	DISPATCH()
+#define DISPATCH_AFTER_H()	DISPATCH()
+#define DISPATCH_AFTER_L()	DISPATCH()
+#define DISPATCH_AFTER_M()	DISPATCH_STORE()
+#define DISPATCH_AFTER_A()	DISPATCH()
 
-	cpu->registers.pc++;
-}
-
-void SBB(Cpu8080 *cpu, uint8_t value)
-{
-	uint16_t result16 = (uint16_t)cpu->registers.A - (uint16_t)value - (uint16_t)cpu->registers.F.cy;
+/* A op value, for the ALU block (0x80-0xBF) and the immediate forms. value is read more than once */
+#define ALU_ADD(value)		cpu->registers.A = add_byte(cpu, cpu->registers.A, (value), 0)
+#define ALU_ADC(value)		cpu->registers.A = add_byte(cpu, cpu->registers.A, (value), carry_flag(cpu))
+#define ALU_SUB(value)		cpu->registers.A = sub_byte(cpu, cpu->registers.A, (value), 0)
+#define ALU_SBB(value)		cpu->registers.A = sub_byte(cpu, cpu->registers.A, (value), carry_flag(cpu))
+#define ALU_ANA(value)		cpu->registers.A = logic_byte(cpu, FLAGS_AND, cpu->registers.A, (value), cpu->registers.A & (value))
+#define ALU_XRA(value)		cpu->registers.A = logic_byte(cpu, FLAGS_OR, cpu->registers.A, (value), cpu->registers.A ^ (value))
+#define ALU_ORA(value)		cpu->registers.A = logic_byte(cpu, FLAGS_OR, cpu->registers.A, (value), cpu->registers.A | (value))
+#define ALU_CMP(value)		sub_byte(cpu, cpu->registers.A, (value), 0)
 
-	BcdArithFlags(cpu, result16);
+/* INR and DCR of a register field, CY is left alone */
+#define INCREMENT(target)											\
+	do {															\
+		uint8_t value = LOAD_##target;								\
+		uint8_t result = value + 1;									\
+																	\
+		defer_flags(cpu, FLAGS_ADD, value, 0, result);				\
+		STORE_##target(result);										\
+	} while (0)
 
-	cpu->registers.A = result16 & 0xFF;
+#define DECREMENT(target)											\
+	do {															\
+		uint8_t value = LOAD_##target;								\
+		uint8_t result = value - 1;									\
+																	\
+		defer_flags(cpu, FLAGS_SUB, value, 0, result);				\
+		STORE_##target(result);										\
+	} while (0)
 
+void NOP(Cpu8080 *cpu) 
+{
 	cpu->registers.pc++;
+	return;
 }
 
-void ANA(Cpu8080 *cpu, uint8_t value)
+void LDA(Cpu8080 *cpu, uint16_t address)
 {
-	cpu->registers.A = cpu->registers.A & value;
-	
-	BcdArithFlags(cpu, (uint16_t)cpu->registers.A);
+	cpu->registers.A = read_memory(cpu, address);
 
-	cpu->registers.F.ac = ((cpu->registers.A | value) & 0x08) != 0;
-	cpu->registers.F.cy = 0;
-
-	cpu->registers.pc++;
+	cpu->registers.pc += 3;
 }
 
-void ANI(Cpu8080 *cpu)
+void LDAX(Cpu8080 *cpu, uint16_t address)
 {
-	uint8_t value = read_byte(cpu);
-
-	ANA(cpu, value);
+	cpu->registers.A = read_memory(cpu, address);
 
 	cpu->registers.pc++;
 }
 
-void XRA(Cpu8080 *cpu, uint8_t value)
+void STAX(Cpu8080 *cpu, uint16_t address)
 {
-	uint16_t result16 = (uint16_t)cpu->registers.A ^ (uint16_t)value;
-
-	BcdArithFlags(cpu, result16);
-	cpu->registers.F.cy = 0;
-	cpu->registers.F.ac = 0;
-
-	cpu->registers.A = result16;
-
-	cpu->registers.pc += 1;
+	write_memory(cpu, address, cpu->registers.A);
+	
+	cpu->registers.pc++;
 }
 
-void XRI(Cpu8080 *cpu)
+void STA(Cpu8080 *cpu, uint16_t address)
 {
-	uint8_t value = read_byte(cpu);
 
-	XRA(cpu, value);
-
-	cpu->registers.pc++;
+	write_memory(cpu, address, cpu->registers.A);
+	cpu->registers.pc += 3;
 }
 
-void ORA(Cpu8080 *cpu, uint8_t *_register)
+void STC(Cpu8080 *cpu)
 {
-	uint16_t result16 = cpu->registers.A | *_register;
-	BcdArithFlags(cpu, result16);
-
-	cpu->registers.F.cy = 0;
-	cpu->registers.F.ac = 0;
-	cpu->registers.A = result16;
-
+	cpu->registers.F |= FLAG_CARRY;
 	cpu->registers.pc++;
 }
 
-void ORI(Cpu8080 *cpu)
+void ACI(Cpu8080 *cpu, uint8_t value)
 {
-	uint8_t value = read_byte(cpu);
+	ALU_ADC(value);
 
-	uint16_t result16 = cpu->registers.A | value;
-	BcdArithFlags(cpu, result16);
-
-	cpu->registers.F.cy = 0;
-	cpu->registers.F.ac = 0;
-	cpu->registers.A = result16;
-
-	cpu->registers.pc++;
+	cpu->registers.pc += 2;
 }
 
-void CMP(Cpu8080 *cpu, uint8_t value) 
+void SBI(Cpu8080 *cpu, uint8_t value)
 {
-	uint16_t result16 = cpu->registers.A - value;
+	ALU_SBB(value);
 
-	cpu->registers.F.z = (result16 == 0);
-	cpu->registers.F.s = (0x80 == (result16 & 0x80));
-	cpu->registers.F.p = parity(result16, 8);
-	cpu->registers.F.cy = (cpu->registers.A < value);
-	cpu->registers.F.ac = cpu->registers.A < (value & 0x0F);
-
-	cpu->registers.pc++;
+	cpu->registers.pc += 2;
 }
 
-void DCX(Cpu8080 *cpu, uint8_t *msbReg, uint8_t *lsbReg) 
+void SUI(Cpu8080 *cpu, uint8_t value)
 {
-	(*lsbReg)--;
-
-	if (*lsbReg == 0xFF)
-	{
-		(*msbReg)--;
-	}
+	ALU_SUB(value);
 
-	cpu->registers.pc++;
+	cpu->registers.pc += 2;
 }
 
-void DCR(Cpu8080 *cpu, uint8_t *_register)
+void ANI(Cpu8080 *cpu, uint8_t value)
 {
-	uint16_t result16 = *_register - 1;
+	ALU_ANA(value);
 
-	cpu->registers.F.z = (result16 == 0);
-	cpu->registers.F.s = (0x80 == (result16 & 0x80));
-	cpu->registers.F.p = parity(result16, 8);
-	cpu->registers.F.ac = cpu->registers.A < (*_register & 0x0F);
-
-	*_register = (result16 & 0xFF);
-
-	cpu->registers.pc++;
+	cpu->registers.pc += 2;
 }
 
-void INX(Cpu8080 *cpu, uint8_t *msbReg, uint8_t *lsbReg) 
+void XRI(Cpu8080 *cpu, uint8_t value)
 {
-	(*lsbReg)++;
-	// overflow
-	if (*lsbReg == 0)
-	{
-		(*msbReg)++;
-	}
+	ALU_XRA(value);
 
-	cpu->registers.pc++;
+	cpu->registers.pc += 2;
 }
 
-void INR(Cpu8080 *cpu, uint8_t *_register)
+void ORI(Cpu8080 *cpu, uint8_t value)
 {
-	uint16_t result16 = (uint16_t)*_register + 1;
-	*_register = (result16 & 0xFF);
+	ALU_ORA(value);
 
-	ArithFlagsA(cpu, result16);
-	cpu->registers.F.ac = cpu->registers.A+ (*_register & 0x0F) > 0x0F;
-
-	cpu->registers.pc++;
+	cpu->registers.pc += 2;
 }
 
-void LHLD(Cpu8080 *cpu)
+void LHLD(Cpu8080 *cpu, uint16_t adress)
 {
-	uint16_t adress = read_byte_address(cpu);
 
-	cpu->registers.L = cpu->memory[adress];
-	cpu->registers.H = cpu->memory[adress + 1];
+	cpu->registers.HL = read_memory_word(cpu, adress);
 
 	cpu->registers.pc += 3;
 }
 
-void CPI(Cpu8080 *cpu) 
+void CPI(Cpu8080 *cpu, uint8_t value) 
 {
-	uint8_t value = read_byte(cpu);
+	ALU_CMP(value);
 
-	CMP(cpu, value);
-	cpu->registers.pc++;
+	cpu->registers.pc += 2;
 }
 
 void CMA(Cpu8080 *cpu)
@@ -439,60 +477,31 @@ void CMA(Cpu8080 *cpu)
 
 void DAA(Cpu8080 *cpu)
 {
-	uint8_t fourLSB = ((cpu->registers.A << 4) >> 4);
-	if ((fourLSB > 0x09) || (cpu->registers.F.ac == 1))
-	{
-		uint16_t resultLSB  = fourLSB + 0x06;
-		cpu->registers.A    = cpu->registers.A + 0x06;
-		BcdArithFlags(cpu, resultLSB);
-	}
-
-	uint8_t fourMSB = (cpu->registers.A >> 4);
-	if ((fourMSB > 0x09) || (cpu->registers.F.cy == 1))
-	{
-		uint16_t resultMSB = fourMSB + 0x06;
-		cpu->registers.A = cpu->registers.A + 0x06;
-		BcdArithFlags(cpu, resultMSB);
-	}
-}
-
-void DAD(Cpu8080 *cpu, uint32_t register_pair) 
-{
-	uint32_t HL = (cpu->registers.H << 8) | cpu->registers.L;
-	uint32_t result = HL + register_pair;
+	resolve_flags(cpu);
 
-	cpu->registers.F.cy = (result > 0xFFFF);
+	uint16_t index = cpu->registers.A | (cpu->registers.F & FLAG_CARRY) << 8 |
+					 ((cpu->registers.F & FLAG_AUX_CARRY) != 0) << 9;
 
-	cpu->registers.H = (uint8_t)(result >> 8);
-	cpu->registers.L = (uint8_t)(result & 0xFF);
+	cpu->registers.A = daa_table[index] & 0xFF;
+	cpu->registers.F = daa_table[index] >> 8;
 
 	cpu->registers.pc += 1;
 }
 
-void ADD(Cpu8080 *cpu, uint8_t value)
+void DAD(Cpu8080 *cpu, uint16_t register_pair) 
 {
-	uint16_t result16 = (uint16_t)value + (uint16_t)cpu->registers.A;
-	uint8_t result8 = result16 & 0xFF;
-
-	cpu->registers.A = result8;
+	uint32_t result = (uint32_t)cpu->registers.HL + register_pair;
 
-	BcdArithFlags(cpu, result16);
+	set_carry(cpu, result > 0xFFFF);
 
-	cpu->registers.F.ac = cpu->registers.A+ (value & 0x0F) > 0x0F;
+	cpu->registers.HL = (uint16_t)result;
 
-	cpu->registers.pc++;
+	cpu->registers.pc += 1;
 }
 
-void ADI(Cpu8080 *cpu)
+void ADI(Cpu8080 *cpu, uint8_t value)
 {
-	uint8_t value = read_byte(cpu);
-
-	uint16_t result16 = value + cpu->registers.A;
-	uint8_t result8 = result16 & 0xFF;
-
-	cpu->registers.A = result8;
-
-	BcdArithFlags(cpu, result16);
+	ALU_ADD(value);
 
 	cpu->registers.pc += 2;
 }
@@ -503,25 +512,19 @@ void RLC(Cpu8080 *cpu)
 
     cpu->registers.A = (cpu->registers.A << 1) | carry;
 
-    if (carry)
-        cpu->registers.F.cy = 1;
-    else
-        cpu->registers.F.cy = 0;
+    set_carry(cpu, carry);
 
     cpu->registers.pc += 1;
 }
 
 void RAL(Cpu8080 *cpu)
 {
-    bool in_carry = cpu->registers.F.cy;
+    bool in_carry = carry_flag(cpu);
     bool out_carry = cpu->registers.A >> 7;
 
     cpu->registers.A = (cpu->registers.A << 1) | in_carry;
 
-    if (out_carry)
-        cpu->registers.F.cy = 1;
-    else
-        cpu->registers.F.cy = 0;
+    set_carry(cpu, out_carry);
 
     cpu->registers.pc += 1;
 }
@@ -532,92 +535,57 @@ void RRC(Cpu8080 *cpu)
 
     cpu->registers.A = (cpu->registers.A >> 1) | (carry << 7);
 
-    if (carry)
-        cpu->registers.F.cy = 1;
-    else
-        cpu->registers.F.cy = 0;
+    set_carry(cpu, carry);
 
     cpu->registers.pc += 1;
 }
 
 void RAR(Cpu8080 *cpu)
 {
-    bool in_carry = cpu->registers.F.cy;
+    bool in_carry = carry_flag(cpu);
     bool out_carry = cpu->registers.A & 1;
 
     cpu->registers.A = (cpu->registers.A >> 1) | (in_carry << 7);
 
-    if (out_carry)
-        cpu->registers.F.cy = 1;
-    else
-        cpu->registers.F.cy = 0;
+    set_carry(cpu, out_carry);
 
     cpu->registers.pc += 1;
 }
 
-void SHLD(Cpu8080 *cpu)
+void SHLD(Cpu8080 *cpu, uint16_t adress)
 {
-	uint16_t adress = read_byte_address(cpu);
 
-	cpu->memory[adress]     = cpu->registers.L;
-	cpu->memory[adress + 1] = cpu->registers.H;
+	write_memory(cpu, adress, cpu->registers.L);
+	write_memory(cpu, adress + 1, cpu->registers.H);
 
 	cpu->registers.pc += 3;
 }
 
 void CMC(Cpu8080 *cpu)
 {
-	cpu->registers.F.cy = ~cpu->registers.F.cy;
+	cpu->registers.F ^= FLAG_CARRY;
 
 	cpu->registers.pc+=1;
 }
 
-void POP(Cpu8080 *cpu, uint8_t *msbReg, uint8_t *lsbReg)
-{
-	uint16_t sp = cpu->registers.sp;
-
-	*lsbReg = cpu->memory[sp];
-	*msbReg = cpu->memory[sp + 1];
-
-	cpu->registers.sp += 2;
-	cpu->registers.pc += 1;
-}
-
 void POP_PSW(Cpu8080 *cpu)
 {
-	uint16_t sp = cpu->registers.sp;
-
-	uint8_t PSW = cpu->memory[sp];
-
-	// carry flag (CY) <- ((SP))_0
-	cpu->registers.F.cy = ((PSW & 0x1) != 0);
-
-	// parity flag (P) <- ((SP))_2
-	cpu->registers.F.p = ((PSW & 0x4) != 0);
-
-	// auxiliary flag (AC) <- ((SP))_4
-	cpu->registers.F.ac = ((PSW & 0x10) != 0);
-
-	// zero flag (Z) <- ((SP))_6
-	cpu->registers.F.z = ((PSW & 0x40) != 0);
-
-	// sign flag (S) <- ((SP))_7
-	cpu->registers.F.s = ((PSW & 0x80) != 0);
-
+	cpu->registers.PSW = read_memory_word(cpu, cpu->registers.sp);
+	cpu->registers.sp += 2;
 
-	
-	cpu->registers.A = cpu->memory[sp+1];
+	// bits 1, 3 and 5 of F are fixed
+	cpu->registers.F = (cpu->registers.F & FLAG_MASK) | FLAG_ALWAYS_ONE;
+	cpu->registers.lazy.op = FLAGS_RESOLVED;
 
-	cpu->registers.sp += 2;
-	cpu->registers.pc+=1;
+	cpu->registers.pc += 1;
 }
 
-void PUSH(Cpu8080 *cpu, uint8_t msbReg, uint8_t lsbReg)
+void PUSH(Cpu8080 *cpu, uint16_t pair)
 {
 	uint16_t sp = cpu->registers.sp;
 
-	cpu->memory[sp-1] = msbReg;
-	cpu->memory[sp-2] = lsbReg;
+	write_memory(cpu, sp - 1, pair >> 8);
+	write_memory(cpu, sp - 2, pair & 0xFF);
 	
 	cpu->registers.sp -= 2;
 	cpu->registers.pc +=1 ;
@@ -625,155 +593,118 @@ void PUSH(Cpu8080 *cpu, uint8_t msbReg, uint8_t lsbReg)
 
 void PUSH_PSW(Cpu8080 *cpu)
 {
-	uint16_t sp = cpu->registers.sp;
-
-	uint8_t flags = 0;
-	flags |= (cpu->registers.F.s << 7);
-	flags |= (cpu->registers.F.z << 6);
-	flags |= (cpu->registers.F.ac << 4);
-	flags |= (cpu->registers.F.p << 2);
-	flags |= (1 << 1);
-	flags |= (cpu->registers.F.cy << 0);
-
-	cpu->memory[sp - 2] = flags;
-	cpu->memory[sp - 1] = cpu->registers.A;
-	cpu->registers.sp -= 2;
+	resolve_flags(cpu);
 
-	cpu->registers.pc += 1;
+	PUSH(cpu, cpu->registers.PSW);
 }
 
-void JC(Cpu8080 *cpu)
+void JC(Cpu8080 *cpu, uint16_t adress_to_pc)
 {
 	unsigned int *PC = &cpu->registers.pc;
 
-	uint16_t adress_to_pc = read_byte_address(cpu);
-
-	if (cpu->registers.F.cy)
+	if (carry_flag(cpu))
 		*PC = adress_to_pc;
 	else
 		(*PC)+=3;
 }
 
-void JNC(Cpu8080 *cpu)
+void JNC(Cpu8080 *cpu, uint16_t adress_to_pc)
 {
 	unsigned int *PC = &cpu->registers.pc;
 
-	uint16_t adress_to_pc = read_byte_address(cpu);
-
-	if (! cpu->registers.F.cy)
+	if (! carry_flag(cpu))
 		*PC = adress_to_pc;
 	else
 		(*PC) += 3;
 }
 
-void JP(Cpu8080 *cpu)
+void JP(Cpu8080 *cpu, uint16_t adress_to_pc)
 {
 	unsigned int *PC = &cpu->registers.pc;
 
-	uint16_t adress_to_pc = read_byte_address(cpu);
-
-	// if Parity bit is TRUE, then
-	if (cpu->registers.F.p)
+	// if Sign bit is false, then
+	if (! sign_flag(cpu))
 	   *PC = adress_to_pc;
 	else
 		(*PC) += 3;
 }
 
-void JPO (Cpu8080 *cpu)
+void JPO(Cpu8080 *cpu, uint16_t adress_to_pc)
 {
 	unsigned int *PC = &cpu->registers.pc;
 
-	uint16_t adress_to_pc = read_byte_address(cpu);
-
 	// if Parity bit is FALSE, then
-	if (! cpu->registers.F.p)
+	if (! parity_flag(cpu))
 		*PC = adress_to_pc;
 	else
 		(*PC) += 3;    
 }
 
-void JM (Cpu8080 *cpu)
+void JM(Cpu8080 *cpu, uint16_t adress_to_pc)
 {
 	unsigned int *PC = &cpu->registers.pc;
 
-	uint16_t adress_to_pc = read_byte_address(cpu);
-
 	// if Sign bit is true, then
-	if (cpu->registers.F.s)
+	if (sign_flag(cpu))
 	   *PC = adress_to_pc;
 	else
 		(*PC) += 3;    
 }
 
-void JNZ (Cpu8080 *cpu)
+void JNZ(Cpu8080 *cpu, uint16_t adress_to_pc)
 {
 	unsigned int *PC = &cpu->registers.pc;
 
-	uint16_t adress_to_pc = read_byte_address(cpu);
-
 	// if ZERO bit is false, then
-	if (! cpu->registers.F.z)
+	if (! zero_flag(cpu))
 		*PC = adress_to_pc;
 	else
 		(*PC) += 3;      
 }
 
-void JZ (Cpu8080 *cpu)
+void JZ(Cpu8080 *cpu, uint16_t adress_to_pc)
 {
 	unsigned int *PC = &cpu->registers.pc;
 
-	uint16_t adress_to_pc = read_byte_address(cpu);
-
 	// if ZERO bit is true, then
-	if (cpu->registers.F.z)
+	if (zero_flag(cpu))
 		*PC = adress_to_pc;
 	else 
 		(*PC) += 3;      
 }
 
-void JPE (Cpu8080 *cpu)
+void JPE (Cpu8080 *cpu, uint16_t adress_to_pc)
 {
-	JP(cpu);  
+	JP(cpu, adress_to_pc);  
 }
 
-void JMP(Cpu8080 *cpu)
+void JMP(Cpu8080 *cpu, uint16_t adress)
 {
 	unsigned int *PC  = &cpu->registers.pc;
-	
-	uint16_t adress = read_byte_address(cpu);
 
 	*PC = adress;
 }
 
 void XCHG(Cpu8080 *cpu)
 {
-	uint8_t prev_H = cpu->registers.H;
-	uint8_t prev_L = cpu->registers.L;
+	uint16_t prev_HL = cpu->registers.HL;
 
-	cpu->registers.H = cpu->registers.D;
-	cpu->registers.L = cpu->registers.E;
-
-	cpu->registers.D = prev_H;
-	cpu->registers.E = prev_L;
+	cpu->registers.HL = cpu->registers.DE;
+	cpu->registers.DE = prev_HL;
 
 	cpu->registers.pc+=1;
 }
 
 void SPHL(Cpu8080 *cpu)
 {
-	uint16_t HL = twoU8_to_u16value(cpu->registers.H, cpu->registers.L);
-	uint16_t *SP = &cpu->registers.sp;
-
-	*SP = HL;
+	cpu->registers.sp = cpu->registers.HL;
 
 	cpu->registers.pc+=1;
 }
 
 void PCHL(Cpu8080 *cpu)
 {
-	uint16_t HL = twoU8_to_u16value(cpu->registers.H, cpu->registers.L);
-			 
-	cpu->registers.pc = HL; 
+	cpu->registers.pc = cpu->registers.HL; 
 }
 
 void XTHL(Cpu8080 *cpu)
@@ -783,11 +714,10 @@ void XTHL(Cpu8080 *cpu)
 	uint8_t temp_l = cpu->registers.L;
 	uint8_t temp_h = cpu->registers.H;
 
-	cpu->registers.L = cpu->memory[sp];
-	cpu->registers.H = cpu->memory[sp + 1];
+	cpu->registers.HL = read_memory_word(cpu, sp);
 
-	cpu->memory[sp] = temp_l;
-	cpu->memory[sp + 1] = temp_h;
+	write_memory(cpu, sp, temp_l);
+	write_memory(cpu, sp + 1, temp_h);
 
 	cpu->registers.pc += 1;
 }
@@ -800,8 +730,8 @@ void CALL(Cpu8080 *cpu, unsigned int adress)
 	uint8_t Higher   = (*PC+3) >> 8;
 	uint8_t Lower  = (*PC+3) & 0xff;
 
-	cpu->memory[SP - 1] = Higher;
-	cpu->memory[SP - 2] = Lower;
+	write_memory(cpu, SP - 1, Higher);
+	write_memory(cpu, SP - 2, Lower);
 
 	/**
 	 * SP   ->  
@@ -830,8 +760,8 @@ void RST(Cpu8080* cpu, uint16_t id)
 	uint8_t Higher = (*PC) >> 8;
 	uint8_t Lower = (*PC) & 0xff;
 
-	cpu->memory[SP - 1] = Higher;
-	cpu->memory[SP - 2] = Lower;
+	write_memory(cpu, SP - 1, Higher);
+	write_memory(cpu, SP - 2, Lower);
 
 	/**
 	 * SP   ->
@@ -849,120 +779,117 @@ void RST(Cpu8080* cpu, uint16_t id)
 	 */
 }
 
-void CALL_adr(Cpu8080 *cpu)
+void CALL_adr(Cpu8080 *cpu, uint16_t adress)
 {
-	unsigned int adress = read_byte_address(cpu);
 	CALL(cpu, adress);	
 }
 
-void CM (Cpu8080 *cpu)
+/* INSTRUCTION_CYCLES holds the not-taken timing, the condition holding adds the rest */
+static inline void taken_call(Cpu8080 *cpu, uint8_t opcode, uint16_t address)
 {
-	unsigned int adress_pc = read_byte_address(cpu);
+	cpu->cycles += INSTRUCTION_CYCLES_TAKEN[opcode] - INSTRUCTION_CYCLES[opcode];
+	CALL(cpu, address);
+}
 
-	// if Sign bit is false, then
-	if (cpu->registers.F.s)
-		CALL(cpu, adress_pc);
+void CM(Cpu8080 *cpu, uint16_t adress_pc)
+{
+
+	// if Sign bit is true, then
+	if (sign_flag(cpu))
+		taken_call(cpu, 0xFC, adress_pc);
 	else
 		cpu->registers.pc += 3;
 }
 
-void CZ (Cpu8080 *cpu)
+void CZ(Cpu8080 *cpu, uint16_t adress_pc)
 {
-	unsigned int adress_pc = read_byte_address(cpu);
 	
 	// if Zero bit is true, then
-	if (cpu->registers.F.z)
-		CALL(cpu, adress_pc);
+	if (zero_flag(cpu))
+		taken_call(cpu, 0xCC, adress_pc);
 	else
 		cpu->registers.pc += 3;    
 }
 
-void CNZ (Cpu8080 *cpu)
+void CNZ(Cpu8080 *cpu, uint16_t adress_pc)
 {
-	unsigned int adress_pc = (unsigned int)read_byte_address(cpu);
 	
 	// if Zero bit is false, then
-	if (! cpu->registers.F.z)
-		CALL(cpu, adress_pc);
+	if (! zero_flag(cpu))
+		taken_call(cpu, 0xC4, adress_pc);
 	else
 		cpu->registers.pc += 3;  
 }
 
-void CC (Cpu8080 *cpu)
+void CC(Cpu8080 *cpu, uint16_t adress_pc)
 {
-	unsigned int adress_pc = (unsigned int)read_byte_address(cpu);
 	
 
 	// if Carry bit is true, then
-	if (cpu->registers.F.cy)
-		CALL(cpu, adress_pc);
+	if (carry_flag(cpu))
+		taken_call(cpu, 0xDC, adress_pc);
 	else
 		cpu->registers.pc += 3;  
 }
 
-void CNC (Cpu8080 *cpu)
+void CNC(Cpu8080 *cpu, uint16_t adress_pc)
 {
-	unsigned int adress_pc = (unsigned int)read_byte_address(cpu);
 
 	// if Carry bit is false, then
-	if (! (cpu->registers.F.cy))
-		CALL(cpu, adress_pc);
+	if (! carry_flag(cpu))
+		taken_call(cpu, 0xD4, adress_pc);
 	else
 		cpu->registers.pc += 3;   
 }
 
-void CP(Cpu8080 *cpu)
+void CP(Cpu8080 *cpu, uint16_t adress_to_pc)
 {
-	uint16_t adress_to_pc = read_byte_address(cpu);
 
-	// if Parity bit is true, then
-	if (cpu->registers.F.p)
-	   CALL(cpu, adress_to_pc);
+	// if Sign bit is false, then
+	if (! sign_flag(cpu))
+	   taken_call(cpu, 0xF4, adress_to_pc);
 	else
 		cpu->registers.pc += 3;
 }
 
-void CPO(Cpu8080 *cpu)
+void CPO(Cpu8080 *cpu, uint16_t adress_to_pc)
 {
-	uint16_t adress_to_pc = read_byte_address(cpu);
 
 	// if Parity bit is false, then
-	if (! cpu->registers.F.p)
-	   CALL(cpu, adress_to_pc);
+	if (! parity_flag(cpu))
+	   taken_call(cpu, 0xE4, adress_to_pc);
 	else
 		cpu->registers.pc += 3;
 }
 
-void CPE(Cpu8080 *cpu)
+void CPE(Cpu8080 *cpu, uint16_t adress_to_pc)
 {
-	uint16_t adress_to_pc = read_byte_address(cpu);
 
 	// if Parity bit is true, then
-	if (cpu->registers.F.p)
-	   CALL(cpu, adress_to_pc);
+	if (parity_flag(cpu))
+	   taken_call(cpu, 0xEC, adress_to_pc);
 	else
 		cpu->registers.pc += 3;
 }
 
 void RET(Cpu8080 *cpu)
 {
-	uint8_t     *memory = cpu->memory;
-	uint16_t    *SP = &cpu->registers.sp;
-
-	unsigned int low = memory[*SP];
-	unsigned int high = memory[*SP + 1];
-
-	*SP+=2;
+	cpu->registers.pc = read_memory_word(cpu, cpu->registers.sp);
+	cpu->registers.sp += 2;
+}
 
-	cpu->registers.pc = (high << 8) | low;
+static inline void taken_return(Cpu8080 *cpu, uint8_t opcode)
+{
+	cpu->cycles += INSTRUCTION_CYCLES_TAKEN[opcode] - INSTRUCTION_CYCLES[opcode];
+	RET(cpu);
 }
 
 void RZ (Cpu8080 *cpu)
 { 
 
 	// if Zero bit is true, then
-	if (cpu->registers.F.z)
-		RET(cpu);
+	if (zero_flag(cpu))
+		taken_return(cpu, 0xC8);
 	else
 		cpu->registers.pc += 1;
 }
@@ -971,8 +898,8 @@ void RNZ (Cpu8080 *cpu)
 {
 
 	// if Zero bit is false, then
-	if (! cpu->registers.F.z)
-		RET(cpu);
+	if (! zero_flag(cpu))
+		taken_return(cpu, 0xC0);
 	else
 		cpu->registers.pc += 1;    
 }
@@ -981,8 +908,8 @@ void RNC (Cpu8080 *cpu)
 { 
 
 	// if Carry bit is false, then
-	if (! (cpu->registers.F.cy))
-		RET(cpu);
+	if (! carry_flag(cpu))
+		taken_return(cpu, 0xD0);
 	else
 		cpu->registers.pc += 1;
 }
@@ -991,17 +918,17 @@ void RC (Cpu8080 *cpu)
 {   
 
 	// if Carry bit is true, then
-	if (cpu->registers.F.cy)
-		RET(cpu);
+	if (carry_flag(cpu))
+		taken_return(cpu, 0xD8);
 	else
 		cpu->registers.pc += 1;    
 }
 
 void RP (Cpu8080 *cpu)
 {   
-	// if Parity bit is true, then
-	if (cpu->registers.F.p)
-		RET(cpu);
+	// if Sign bit is false, then
+	if (! sign_flag(cpu))
+		taken_return(cpu, 0xF0);
 	else
 		cpu->registers.pc += 1;
 }
@@ -1009,8 +936,8 @@ void RP (Cpu8080 *cpu)
 void RPO (Cpu8080 *cpu)
 {   
 	// if Parity bit is false, then
-	if (! cpu->registers.F.p)
-		RET(cpu);
+	if (! parity_flag(cpu))
+		taken_return(cpu, 0xE0);
 	else
 		cpu->registers.pc += 1;
 }
@@ -1018,8 +945,8 @@ void RPO (Cpu8080 *cpu)
 void RPE (Cpu8080 *cpu)
 {   
 	// if Parity bit is true, then
-	if (cpu->registers.F.p)
-		RET(cpu);
+	if (parity_flag(cpu))
+		taken_return(cpu, 0xE8);
 	else
 		cpu->registers.pc += 1;
 }
@@ -1028,8 +955,8 @@ void RM (Cpu8080 *cpu)
 {    
 
 	// if sign bit is true, then
-	if (cpu->registers.F.s)
-		RET(cpu);
+	if (sign_flag(cpu))
+		taken_return(cpu, 0xF8);
 	else
 		cpu->registers.pc += 1;    
 }
@@ -1046,1182 +973,1192 @@ void DI(Cpu8080* cpu)
 	cpu->registers.pc+=1;
 }
 
-void HLT()
+void HLT(Cpu8080 *cpu)
 {
-	
+	// nothing runs until an interrupt is taken, which returns past the HLT
+	cpu->halted = true;
+	cpu->registers.pc += 1;
 }
 
-void IN(Cpu8080* cpu)
+void IN(Cpu8080* cpu, uint8_t port)
 {
-	uint8_t port = cpu->rom[cpu->registers.pc + 1];
-	cpu->registers.A = io_read(port);
+	cpu->registers.A = io_read(cpu, port);
 	cpu->registers.pc += 2;
 }
 
-void OUT(Cpu8080 *cpu)
+void OUT(Cpu8080 *cpu, uint8_t port)
 {
-	uint8_t port = cpu->rom[cpu->registers.pc + 1];
 	io_write(cpu, port);
 	cpu->registers.pc += 2;
 }
 
+/*
+ * Map the process' ROM image at ROM_LOAD_ADDRESS: its pages are shared
+ * where the board has ROM, anything else is copied into RAM.
+ */
 static inline void load_rom(Cpu8080 *cpu)
 {
-	cpu->rom = get_rom();
+	const RomImage *rom = acquire_rom();
 
-	if (cpu->rom == NULL)
+	if (rom == NULL)
 	{
 		fprintf(stderr, "Failed to load ROM\n");
 		exit(EXIT_FAILURE);
 		return;
 	}
+
+	release_rom(cpu->rom);
+	cpu->rom = rom;
+
+#if ROM_ARCADE_MAP
+	map_rom(&cpu->memory_map, ROM_START, ROM_END);
+	map_ram(&cpu->memory_map, RAM_START, RAM_END);
+	map_mirror(&cpu->memory_map, RAM_MIRROR_START, RAM_MIRROR_END, RAM_START, RAM_END);
+#endif
+
+	for (unsigned index = 0; index < rom->page_count; index++)
+	{
+		unsigned offset = index << MEMORY_PAGE_SHIFT;
+		uint16_t address = ROM_LOAD_ADDRESS + offset;
+
+		if (cpu->memory_map.type[address >> MEMORY_PAGE_SHIFT] == PAGE_ROM)
+		{
+			map_shared_rom(&cpu->memory_map, address, rom->pages[index]);
+			continue;
+		}
+
+		unsigned length = (rom->size - offset < MEMORY_PAGE_SIZE) ? rom->size - offset : MEMORY_PAGE_SIZE;
+
+		memcpy(cpu->memory + address, rom->pages[index]->bytes, length);
+	}
 }
 
-static inline void load_rom_to_memory(Cpu8080 *cpu) 
+/* Take an interrupt as if the device had put RST id on the bus; ignored while interrupts are disabled */
+static void interrupt(Cpu8080 *cpu, uint16_t id)
 {
-	size_t rom_size = get_rom_size();
-	memcpy(cpu->memory, cpu->rom, rom_size);
+	if (!cpu->interrupt_enabled)
+		return;
+
+	// accepting an interrupt disables further ones until the handler's EI
+	cpu->interrupt_enabled = false;
+	cpu->halted = false;
+	RST(cpu, id);
 }
 
-void timer_irq(Cpu8080 *cpu)
+static void mid_screen_irq(Cpu8080 *cpu)
 {
-	if (cpu->cycles % TIMER_INTERRUPT_CYCLES == 0)
-	{
-		RST(cpu, 0x01);
-	}
+	interrupt(cpu, 0x01);
 }
 
-void vblank_irq(Cpu8080 *cpu)
+static void vblank_irq(Cpu8080 *cpu)
 {
-	if (cpu->cycles % VBLANK_INTERRUPT_CYCLES == 0)
-	{
-		RST(cpu, 0x02);
-	}
+	interrupt(cpu, 0x02);
 }
 
-static inline uint8_t emulate_instruction(Cpu8080 *cpu)
+static void schedule_video_interrupts(Cpu8080 *cpu)
 {
-	uint8_t instruction = cpu->rom[cpu->registers.pc];
-	uint16_t address = (cpu->registers.H << 8) | (cpu->registers.L);
+	scheduler_add(&cpu->scheduler, EVENT_MID_SCREEN, cpu->cycles + MID_SCREEN_INTERRUPT_CYCLES,
+				  CYCLES_PER_FRAME, mid_screen_irq);
+	scheduler_add(&cpu->scheduler, EVENT_VBLANK, cpu->cycles + VBLANK_INTERRUPT_CYCLES,
+				  CYCLES_PER_FRAME, vblank_irq);
+}
 
-	switch (instruction) {
-		case 0x00: case 0x08: case 0x10: case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
-			NOP(cpu);
-			break;
+static inline void finish_instruction(Cpu8080 *cpu, uint8_t instruction)
+{
+	cpu->cycles += INSTRUCTION_CYCLES[instruction];
 
-		case 0x01:
-			LXI(cpu, &cpu->registers.B, &cpu->registers.C);
-			break;
+	if (cpu->cycles >= cpu->scheduler.next)
+		scheduler_run(&cpu->scheduler, cpu, cpu->cycles);
 
-		case 0x02:
-			STAX(cpu, &cpu->registers.B, &cpu->registers.C);
-			break;
+	external_dev_routine(cpu);
+}
 
-		case 0x03:
-			INX(cpu, &cpu->registers.B, &cpu->registers.C);
-			break;
+static inline bool is_hooked(Cpu8080 *cpu, uint16_t address)
+{
+	return cpu->hook_bitmap[address >> 6] & (1ull << (address & 63));
+}
 
-		case 0x04:
-			INR(cpu, &cpu->registers.B);
-			break;
+/*
+ * Run the hook at registers.pc, if there is one, and return from it.
+ * Counts as one instruction, the RET.
+ */
+static bool call_hook(Cpu8080 *cpu)
+{
+	uint16_t address = cpu->registers.pc;
 
-		case 0x05:
-			DCR(cpu, &cpu->registers.B);
-			break;
+	if (!is_hooked(cpu, address))
+		return false;
 
-		case 0x06: /*MVI B,D8 */
-			cpu->registers.B = cpu->rom[cpu->registers.pc + 1];
-			cpu->registers.pc += 2;
-			break;
+	for (unsigned i = 0; i < cpu->hook_count; i++)
+	{
+		if (cpu->hooks[i].address != address)
+			continue;
 
-		case 0x07:
-			RLC(cpu);
-			break;
+		resolve_flags(cpu);
+		cpu->cycles += cpu->hooks[i].run(cpu, cpu->hooks[i].context);
+
+		if (!cpu->halted)
+			RET(cpu);
+
+		finish_instruction(cpu, 0xC9);
+		return true;
+	}
 
-		case 0x09:
+	return false;
+}
+
+static inline bool retire_instruction(Cpu8080 *cpu, uint8_t *instruction, uint64_t *executed, uint64_t count)
+{
+	finish_instruction(cpu, *instruction);
+
+	if (++(*executed) == count || cpu->halted)
+		return false;
+
+	// the caller runs the hook
+	if (cpu->hook_count && is_hooked(cpu, cpu->registers.pc))
+		return false;
+
+	*instruction = fetch_opcode(cpu);
+	return true;
+}
+
+/*
+ * Dispatch.
+ *
+ * The handler bodies live in cpu_handlers.inc and are expanded into two
+ * loops: emulate_instructions() decodes straight from the ROM image, while
+ * execute_block() runs the micro-ops of a pre-decoded Block.
+ *
+ * With GCC/Clang both loops are threaded: every handler finishes by jumping
+ * through dispatch_table (or its micro-op's handler pointer) on its own
+ * indirect branch, so the predictor learns per-opcode successors instead of
+ * sharing the single branch of the switch. Define NO_COMPUTED_GOTO (or use a
+ * compiler without labels-as-values) to get the portable switch loops.
+ *
+ * Threaded execute_block() also has the superinstruction handlers of
+ * cpu_superinstructions.inc, which the block decoder puts on common opcode
+ * pairs so they cost one dispatch instead of two.
+ */
+#if defined(__GNUC__) && !defined(NO_COMPUTED_GOTO)
+#define THREADED_DISPATCH
+#endif
+
+#define HL_ADDRESS (cpu->registers.HL)
+
+/*
+ * Generators for the register-operand handlers of cpu_handlers.inc, one
+ * handler per opcode with its register field and pair fixed at compile
+ * time (see LOAD_B and friends).
+ */
+#define MOV_HANDLER(code, target, source)							\
+	OPCODE(code):													\
+		STORE_##target(LOAD_##source);								\
+		cpu->registers.pc += 1;										\
+		DISPATCH_AFTER_##target();
+
+#define MVI_HANDLER(code, target)									\
+	OPCODE(code):													\
+		STORE_##target(IMM8);										\
+		cpu->registers.pc += 2;										\
+		DISPATCH_AFTER_##target();
+
+#define ALU_HANDLER(code, operation, source)						\
+	OPCODE(code):													\
+	{																\
+		uint8_t value = LOAD_##source;								\
+																	\
+		ALU_##operation(value);										\
+		cpu->registers.pc += 1;										\
+		DISPATCH();													\
+	}
+
+#define INR_HANDLER(code, target)									\
+	OPCODE(code):													\
+		INCREMENT(target);											\
+		cpu->registers.pc += 1;										\
+		DISPATCH_AFTER_##target();
+
+#define DCR_HANDLER(code, target)									\
+	OPCODE(code):													\
+		DECREMENT(target);											\
+		cpu->registers.pc += 1;										\
+		DISPATCH_AFTER_##target();
+
+#define LXI_HANDLER(code, pair)										\
+	OPCODE(code):													\
+		cpu->registers.pair = IMM16;								\
+		cpu->registers.pc += 3;										\
+		DISPATCH();
+
+#define INX_HANDLER(code, pair)										\
+	OPCODE(code):													\
+		cpu->registers.pair++;										\
+		cpu->registers.pc += 1;										\
+		DISPATCH();
+
+#define DCX_HANDLER(code, pair)										\
+	OPCODE(code):													\
+		cpu->registers.pair--;										\
+		cpu->registers.pc += 1;										\
+		DISPATCH();
+
+#define POP_HANDLER(code, pair)										\
+	OPCODE(code):													\
+		cpu->registers.pair = read_memory_word(cpu, cpu->registers.sp);	\
+		cpu->registers.sp += 2;										\
+		cpu->registers.pc += 1;										\
+		DISPATCH();
+
+/* HANDLER(code, argument, field) for each value of the register field, in encoding order */
+#define REGISTER_FIELD(HANDLER, argument, b, c, d, e, h, l, m, a)	\
+	HANDLER(b, argument, B) HANDLER(c, argument, C)					\
+	HANDLER(d, argument, D) HANDLER(e, argument, E)					\
+	HANDLER(h, argument, H) HANDLER(l, argument, L)					\
+	HANDLER(m, argument, M) HANDLER(a, argument, A)
+
+#ifdef THREADED_DISPATCH
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+#define OPCODE(op)			op_##op: case op
+#define OPCODE_UNDEFINED	op_undefined: default
+
+#define HANDLER_DEFINED(code)		&&op_##code
+#define HANDLER_UNDEFINED(code)		&&op_undefined
+#define OPCODE_HANDLER(code, kind, mnemonic, length, cycles, taken)	[code] = HANDLER_##kind(code),
+
+#define DISPATCH_TABLE		OPCODES(OPCODE_HANDLER)
+
+#define SUPERINSTRUCTION(name)	super_##name
+
+#define SUPERINSTRUCTION_TABLE \
+	[256 + SUPER_DCR_B_JNZ] = &&super_DCR_B_JNZ, \
+	[256 + SUPER_ANA_A_JNZ] = &&super_ANA_A_JNZ, \
+	[256 + SUPER_ANA_A_JZ] = &&super_ANA_A_JZ, \
+	[256 + SUPER_MOV_A_M_ANA_A] = &&super_MOV_A_M_ANA_A, \
+	[256 + SUPER_MOV_A_M_INX_H] = &&super_MOV_A_M_INX_H, \
+	[256 + SUPER_INX_H_DCR_B] = &&super_INX_H_DCR_B, \
+	[256 + SUPER_INX_H_INX_D] = &&super_INX_H_INX_D, \
+	[256 + SUPER_LDA_ANA_A] = &&super_LDA_ANA_A, \
+	[256 + SUPER_LDA_CPI] = &&super_LDA_CPI, \
+	[256 + SUPER_MOV_M_A_INX_H] = &&super_MOV_M_A_INX_H, \
+	[256 + SUPER_LDAX_D_MOV_M_A] = &&super_LDAX_D_MOV_M_A
+#else
+#define OPCODE(op)			case op
+#define OPCODE_UNDEFINED	default
+#endif
+
+/* Micro-op handler addresses of execute_block(), NULL in switch builds */
+static const void *const *block_handlers;
+
+static uint64_t emulate_instructions(Cpu8080 *cpu, uint64_t count)
+{
+	uint64_t executed = 0;
+	uint8_t instruction = fetch_opcode(cpu);
+
+#ifdef THREADED_DISPATCH
+	static const void *const dispatch_table[256] = { DISPATCH_TABLE };
+
+#define DISPATCH()																\
+	do {																		\
+		if (!retire_instruction(cpu, &instruction, &executed, count))			\
+			return executed;													\
+		goto *dispatch_table[instruction];										\
+	} while (0)
+#else
+#define DISPATCH()			continue
+#endif
+#define DISPATCH_STORE()	DISPATCH()
+#define STOP_DISPATCH()		return executed
+#define IMM8				read_byte(cpu)
+#define IMM16				read_byte_address(cpu)
+
+	if (count == 0)
+		return 0;
+
+	do
+	{
+		switch (instruction)
 		{
-			uint32_t bc = (cpu->registers.B << 8) | cpu->registers.C;
-			DAD(cpu, bc);
-			break;
+#include "cpu_handlers.inc"
 		}
+	} while (retire_instruction(cpu, &instruction, &executed, count));
 
-		case 0x0A:
-			LDAX(cpu, &cpu->registers.B, &cpu->registers.C);
-			break;
+	return executed;
 
-		case 0x0B:
-			DCX(cpu, &cpu->registers.B, &cpu->registers.C);
-			break;
+#undef DISPATCH
+#undef DISPATCH_STORE
+#undef STOP_DISPATCH
+#undef IMM8
+#undef IMM16
+}
 
-		case 0x0C:
-			INR(cpu, &cpu->registers.C);
-			break;
+/*
+ * Run one pre-decoded block and return the micro-ops it retired.
+ * Immediates come from the micro-ops and cycle accounting is left to the
+ * caller, which adds block->cycles once, or block_cycles() of the ops run
+ * when a store into the block evicted it part way.
+ * Called with a NULL block it only publishes its handler table, once from
+ * build_tables().
+ */
+static uint64_t execute_block(Cpu8080 *cpu, const Block *block)
+{
+#ifdef THREADED_DISPATCH
+	static const void *const dispatch_table[256 + SUPER_COUNT] = { DISPATCH_TABLE SUPERINSTRUCTION_TABLE };
 
-		case 0x0D:
-			DCR(cpu, &cpu->registers.C);
-			break;
+	if (block == NULL)
+	{
+		block_handlers = dispatch_table;
+		return 0;
+	}
 
-		case 0x0E:
-			cpu->registers.C = cpu->rom[cpu->registers.pc + 1];
-			cpu->registers.pc += 2;
-			break;
-	
-		case 0x0F:
-			RRC(cpu);
-			break;
-	
-		case 0x11:
-			LXI(cpu, &cpu->registers.D, &cpu->registers.E);
-			break;
-
-		case 0x12:
-			STAX(cpu, &cpu->registers.D, &cpu->registers.E);
-			break;
-
-		case 0x13:
-			INX(cpu, &cpu->registers.D, &cpu->registers.E);
-			break;
-
-		case 0x14:
-			INR(cpu, &cpu->registers.D);
-			break;
-
-		case 0x15:
-			DCR(cpu, &cpu->registers.D);
-			break;
-
-		case 0x16:
-			*D = cpu->rom[cpu->registers.pc + 1];
-			cpu->registers.pc += 2;
-			break;
-	
-		case 0x17:
-			RAL(cpu);		
-			break;
-
-		case 0x19:
+#define DISPATCH()																\
+	do {																		\
+		if (op == last)															\
+			return block->count;												\
+		op++;																	\
+		goto *op->handler;														\
+	} while (0)
+
+/* Superinstructions retire their second micro-op as well */
+#define DISPATCH_PAIR()		do { op++; DISPATCH(); } while (0)
+#define NEXT_IMM8			((uint8_t)op[1].operand)
+#define NEXT_IMM16			(op[1].operand)
+#else
+	if (block == NULL)
+		return 0;
+
+#define DISPATCH()			continue
+#endif
+/* A store that evicted the block ends it after the storing micro-op, the rest must be decoded again */
+#define DISPATCH_STORE()														\
+	do {																		\
+		if (block->count == 0)													\
+			return (uint64_t)(op - block->ops) + 1;								\
+		DISPATCH();																\
+	} while (0)
+#define STOP_DISPATCH()		return (uint64_t)(op - block->ops)
+#define IMM8				((uint8_t)op->operand)
+#define IMM16				(op->operand)
+
+	const MicroOp *op = block->ops;
+	const MicroOp *last = block->ops + block->count - 1;
+
+	do
+	{
+		switch (op->opcode)
 		{
-			uint32_t de = (cpu->registers.D << 8) | cpu->registers.E;
-			DAD(cpu, de);
-			break;
+#include "cpu_handlers.inc"
+#ifdef THREADED_DISPATCH
+#include "cpu_superinstructions.inc"
+#endif
 		}
+	} while (op++ != last);
 
-		case 0x1A:
-			LDAX(cpu, &cpu->registers.D, &cpu->registers.E);
-			break;
+	return block->count;
 
-		case 0x1B:
-			DCX(cpu, &cpu->registers.D, &cpu->registers.E);
-			break;
+#ifdef THREADED_DISPATCH
+#undef DISPATCH_PAIR
+#undef NEXT_IMM8
+#undef NEXT_IMM16
+#endif
+#undef DISPATCH
+#undef DISPATCH_STORE
+#undef STOP_DISPATCH
+#undef IMM8
+#undef IMM16
+}
 
-		case 0x1C:
-			INR(cpu, &cpu->registers.E);
-			break;
+#undef OPCODE
+#undef OPCODE_UNDEFINED
 
-		case 0x1D:
-			DCR(cpu, &cpu->registers.E);
-			break;
+#undef MOV_HANDLER
+#undef MVI_HANDLER
+#undef ALU_HANDLER
+#undef INR_HANDLER
+#undef DCR_HANDLER
+#undef LXI_HANDLER
+#undef INX_HANDLER
+#undef DCX_HANDLER
+#undef POP_HANDLER
+#undef REGISTER_FIELD
 
-		case 0x1E:
-			cpu->registers.E = cpu->rom[cpu->registers.pc + 1];
-			cpu->registers.pc+=2;
-			break;
+#ifdef THREADED_DISPATCH
+#undef SUPERINSTRUCTION
+#pragma GCC diagnostic pop
+#endif
 
-		case 0x1F:
-			RAR(cpu);
-			break;
+/* Whether an event falls due before the last instruction of a run of cycles completes */
+static inline bool crosses_interrupt(Cpu8080 *cpu, uint16_t cycles)
+{
+	return cpu->cycles + cycles >= cpu->scheduler.next;
+}
 
-		case 0x21:
-			LXI(cpu, &cpu->registers.H, &cpu->registers.L);
-			break;
+/* Clock states of the first count micro-ops of a block, conditional CALL and RET not taken */
+static uint32_t block_cycles(const Block *block, uint64_t count)
+{
+	uint32_t cycles = 0;
 
-		case 0x22:
-			SHLD(cpu);
-			break;
-		
-		case 0x23:
-			INX(cpu, &cpu->registers.H, &cpu->registers.L);
-			break;
+	for (uint64_t i = 0; i < count; i++)
+		cycles += INSTRUCTION_CYCLES[block->ops[i].opcode];
 
-		case 0x24:
-			INR(cpu, &cpu->registers.H);
-			break;
+	return cycles;
+}
 
-		case 0x25:
-			DCR(cpu, &cpu->registers.H);
-			break;
+void enable_block_cache(Cpu8080 *cpu)
+{
+	cpu->block_cache = block_cache_create();
+}
 
-		case 0x26:
-			*H = cpu->rom[cpu->registers.pc + 1];
-			cpu->registers.pc += 2;
-			break;
+/* Translated code (JIT or AOT) runs the instructions it does not inline through here */
+uint8_t execute_op(Cpu8080 *cpu, uint8_t opcode, uint16_t operand)
+{
+	Block block;
 
-		case 0x27:
-			DAA(cpu);
-			break;
+	block.count = 1;
+	block.ops[0].handler = block_handlers ? block_handlers[opcode] : NULL;
+	block.ops[0].operand = operand;
+	block.ops[0].opcode = opcode;
 
-		case 0x29:
-		{
-			uint32_t hl = (cpu->registers.H << 8) | cpu->registers.L;
-			DAD(cpu, hl);
-			break;
-		}
+	execute_block(cpu, &block);
+	resolve_flags(cpu);
+	external_dev_routine(cpu);
 
-		case 0x2a:
-			LHLD(cpu);
-			break;
+	return cpu->jit && cpu->jit->invalidated;
+}
 
-		case 0x2b:
-			DCX(cpu, &cpu->registers.H, &cpu->registers.L);
-			break;
+uint8_t store_byte(Cpu8080 *cpu, uint16_t address, uint8_t value)
+{
+	write_memory(cpu, address, value);
 
-		case 0x2c:
-			INR(cpu, &cpu->registers.L);
-			break;
+	return cpu->jit && cpu->jit->invalidated;
+}
 
-		case 0x2d:
-			DCR(cpu, &cpu->registers.L);
-			break;
+uint8_t load_byte(Cpu8080 *cpu, uint16_t address)
+{
+	return read_memory(cpu, address);
+}
 
-		case 0x2e:
-			*L = cpu->rom[cpu->registers.pc + 1];
-			cpu->registers.pc+=2;
-			break;
+void enable_jit(Cpu8080 *cpu)
+{
+	cpu->jit = jit_create(execute_op, store_byte, load_byte);
 
-		case 0x2f:
-			CMA(cpu);
-			break;
+	if (cpu->jit == NULL)
+		fprintf(stderr, "JIT unavailable on this host, running the block cache\n");
+}
 
+/* First cycle count at which an interrupt may be raised */
+static inline uint64_t next_interrupt(Cpu8080 *cpu)
+{
+	return cpu->scheduler.next;
+}
 
-		case 0x31:
-		{
-			uint16_t PC = cpu->registers.pc;
-			cpu->registers.sp = (cpu->rom[PC + 2] << 8) | cpu->rom[PC + 1];
-			
-			cpu->registers.pc+=3;
+static inline const void* translated_block(Cpu8080 *cpu, Block *block)
+{
+	const void *code = jit_lookup(cpu->jit, block->start);
 
-			break;
-		}
+	if (code == NULL && ++block->hits >= JIT_HOT_THRESHOLD)
+	{
+		code = jit_compile(cpu->jit, block);
+		block->hits = 0;
+	}
 
-		case 0x32:
-			STA(cpu);
-			break;
+	return code;
+}
 
-		case 0x33:
-			cpu->registers.sp++;
-			break;
+#if JIT_VERIFY
+static void print_state(const char *label, const Cpu8080 *cpu)
+{
+	const Registers *r = &cpu->registers;
 
-		case 0x34:
-			INR(cpu, &cpu->memory[address]);
-			break;
+	fprintf(stderr, "%-11s A=%02X B=%02X C=%02X D=%02X E=%02X H=%02X L=%02X "
+			"F=%02X SP=%04X PC=%04X IE=%u cycles=%llu\n",
+			label, r->A, r->B, r->C, r->D, r->E, r->H, r->L,
+			r->F, r->sp, r->pc,
+			cpu->interrupt_enabled, (unsigned long long)cpu->cycles);
+}
 
-		case 0x35:
-				DCR(cpu, &cpu->memory[address]);
-			break;
+static bool same_state(const Cpu8080 *a, const Cpu8080 *b)
+{
+	const Registers *x = &a->registers;
+	const Registers *y = &b->registers;
 
-		case 0x36:
-		{
-			uint8_t value = read_byte(cpu);
-			cpu->memory[address] = value;
-			cpu->registers.pc+=2;	
-		}
-			break;
+	return x->A == y->A && x->B == y->B && x->C == y->C && x->D == y->D &&
+		   x->E == y->E && x->H == y->H && x->L == y->L &&
+		   x->F == y->F &&
+		   x->sp == y->sp && x->pc == y->pc &&
+		   a->interrupt_enabled == b->interrupt_enabled && a->cycles == b->cycles;
+}
 
-		case 0x37:
-			STC(cpu);
-			break;
+/*
+ * Run a single translated block, then rewind and replay the same
+ * instructions through the interpreter; any difference aborts.
+ */
+static uint64_t verify_translated(Cpu8080 *cpu, const void *code)
+{
+	// static, an instance with its memory is too large for the stack
+	static _Thread_local Cpu8080 before;
+	static _Thread_local Cpu8080 translated;
 
-		case 0x39:
-			DAD(cpu, cpu->registers.sp);
-			break;
+	before = *cpu;
 
-		case 0x3A:
-			LDA(cpu);
-			break;
+	uint64_t executed = jit_run(cpu->jit, cpu, code, next_interrupt(cpu), 1);
 
-		case 0x3B:
-			cpu->registers.sp--;
-			cpu->registers.pc++;
-			break;
+	translated = *cpu;
 
-		case 0x3C:
-			INR(cpu, &cpu->registers.A);
-			break;
+	cpu->registers = before.registers;
+	cpu->cycles = before.cycles;
+	cpu->interrupt_enabled = before.interrupt_enabled;
+	memcpy(cpu->memory, before.memory, TOTAL_MEMORY_SIZE);
+	memcpy(cpu->io_data, before.io_data, sizeof(cpu->io_data));
 
-		case 0x3D:
-			DCR(cpu, &cpu->registers.A);
-			break;
+	emulate_instructions(cpu, executed);
+	resolve_flags(cpu);
+
+	if (!same_state(cpu, &translated) || memcmp(cpu->memory, translated.memory, TOTAL_MEMORY_SIZE) != 0)
+	{
+		fprintf(stderr, "JIT mismatch in block at %04X after %llu instructions\n",
+				before.registers.pc, (unsigned long long)executed);
+		print_state("before:", &before);
+		print_state("translated:", &translated);
+		print_state("interpreter:", cpu);
 
-		case 0x3E:
+		for (unsigned address = 0; address < TOTAL_MEMORY_SIZE; address++)
 		{
-			uint8_t value = read_byte(cpu);
-			cpu->registers.A = value;
-			cpu->registers.pc += 2;
-			break;
+			if (cpu->memory[address] != translated.memory[address])
+				fprintf(stderr, "memory[%04X]: translated %02X, interpreter %02X\n",
+						address, translated.memory[address], cpu->memory[address]);
 		}
 
-		case 0x3F:
-			CMC(cpu);
-			break;
-
-		case 0x40:
-			*B = *B;
-			cpu->registers.pc += 1;
-			break;
-		case 0x41:
-			*B = *C;
-			cpu->registers.pc += 1;
-			break;
-		case 0x42:
-			*B = *D;
-			cpu->registers.pc += 1;
-			break;
-		case 0x43:
-			*B = *E;
-			cpu->registers.pc += 1;
-			break;
-		case 0x44:
-			*B = *H;
-			cpu->registers.pc += 1;
-			break;
-		case 0x45:
-			*B = *L;
-			cpu->registers.pc += 1;
-			break;
-		case 0x46:
-			*B = cpu->memory[address];
-			cpu->registers.pc += 1;
-			break;
-		case 0x47:
-			*B = *A;
-			cpu->registers.pc += 1;
-			break;
-		case 0x48:
-			*C = *B;
-			cpu->registers.pc += 1;
-			break;
-		case 0x49:
-			*C = *C;
-			cpu->registers.pc += 1;
-			break;
-		case 0x4A:
-			*C = *D;
-			cpu->registers.pc += 1;
-			break;
-		case 0x4B:
-			*C = *E;
-			cpu->registers.pc += 1;
-			break;
-		case 0x4C:
-			*C = *H;
-			cpu->registers.pc += 1;
-			break;
-		case 0x4D:
-			*C = *L;
-			cpu->registers.pc += 1;
-			break;
-		case 0x4E:
-			*C = cpu->memory[address];
-			cpu->registers.pc += 1;
-			break;
-		case 0x4F:
-			*C = *A;
-			cpu->registers.pc += 1;
-			break;
-		case 0x50:
-			*D = *B;
-			cpu->registers.pc += 1;
-			break;
-		case 0x51:
-			*D = *C;
-			cpu->registers.pc += 1;
-			break;
-		case 0x52:
-			*D = *D;
-			cpu->registers.pc += 1;
-			break;
-		case 0x53:
-			*D = *E;
-			cpu->registers.pc += 1;
-			break;
-		case 0x54:
-			*D = *H;
-			cpu->registers.pc += 1;
-			break;
-		case 0x55:
-			*D = *L;
-			cpu->registers.pc += 1;
-			break;
-		case 0x56:
-			*D = cpu->memory[address];
-			cpu->registers.pc += 1;
-			break;
-		case 0x57:
-			*D = *A;
-			cpu->registers.pc += 1;
-			break;
-
-		case 0x58:
-			cpu->registers.E = cpu->registers.B;
-			cpu->registers.pc += 1;
-			break;
-
-		case 0x59:
-			cpu->registers.E = cpu->registers.C;
-			cpu->registers.pc += 1;
-			break;
-
-		case 0x5a:
-			cpu->registers.E = cpu->registers.D;
-			cpu->registers.pc += 1;
-			break;
+		exit(EXIT_FAILURE);
+	}
 
-		case 0x5b:
-			cpu->registers.E = cpu->registers.E;
-			cpu->registers.pc += 1;
-			break;
+	return executed;
+}
+#endif
 
-		case 0x5c:
-			cpu->registers.E = cpu->registers.H;
-			cpu->registers.pc += 1;
-			break;
+static uint64_t run_translated(Cpu8080 *cpu, const void *code, uint64_t budget)
+{
+	resolve_flags(cpu);
+	cpu->jit->invalidated = false;
 
-		case 0x5d:
-			cpu->registers.E = cpu->registers.L;
-			cpu->registers.pc += 1;
-			break;
+#if JIT_VERIFY
+	(void)budget;
+	uint64_t executed = verify_translated(cpu, code);
+#else
+	uint64_t executed = jit_run(cpu->jit, cpu, code, next_interrupt(cpu), budget);
+#endif
 
-		case 0x5e:
-			cpu->registers.E = cpu->memory[address];
-			cpu->registers.pc += 1;
-			break;
+	return executed;
+}
 
-		case 0x5f:
-			cpu->registers.E = cpu->registers.A;
-			cpu->registers.pc += 1;
-			break;
+static inline bool same_registers(const Registers *a, const Registers *b)
+{
+	return a->BC == b->BC && a->DE == b->DE && a->HL == b->HL && a->PSW == b->PSW &&
+		   a->sp == b->sp && a->pc == b->pc;
+}
 
-		case 0x60:
-			cpu->registers.H = cpu->registers.B;
-			cpu->registers.pc += 1;
-			break;
+/*
+ * Busy-waits.
+ *
+ * A spin block jumps back to its own start and stores nothing, so a pass
+ * that leaves every register as it found it will be repeated unchanged
+ * until an interrupt handler writes whatever is being polled. Those passes
+ * are retired at once, up to the last one that completes before the next
+ * event; the pass that reaches the event is stepped as usual. Spin blocks
+ * are never handed to the JIT, every pass goes through here.
+ */
+static uint64_t run_spin(Cpu8080 *cpu, const Block *block, uint64_t budget)
+{
+	resolve_flags(cpu);
+	Registers before = cpu->registers;
 
-		case 0x61:
-			cpu->registers.H = cpu->registers.C;
-			cpu->registers.pc += 1;
-			break;
+	uint64_t executed = execute_block(cpu, block);
+	cpu->cycles += block->cycles;
 
-		case 0x62:
-			cpu->registers.H = cpu->registers.D;
-			cpu->registers.pc += 1;
-			break;
-			
-		case 0x63:
-			cpu->registers.H = cpu->registers.E;
-			cpu->registers.pc += 1;
-			break;
+	if (executed >= budget || cpu->error_occurred == 5)
+		return executed;
 
-		case 0x64:
-			cpu->registers.H = cpu->registers.H;
-			cpu->registers.pc += 1;
-			break;
+	resolve_flags(cpu);
 
-		case 0x65:
-			cpu->registers.H = cpu->registers.L;
-			cpu->registers.pc += 1;
-			break;
+	if (!same_registers(&before, &cpu->registers) || cpu->scheduler.next <= cpu->cycles)
+		return executed;
 
-		case 0x66:
-			cpu->registers.H = cpu->memory[address];
-			cpu->registers.pc += 1;
-			break;
+	uint64_t passes = (cpu->scheduler.next - cpu->cycles - 1) / block->cycles;
+	uint64_t room = (budget - executed) / block->count;
 
-		case 0x67:
-			cpu->registers.H = cpu->registers.A;
-			cpu->registers.pc += 1;
-			break;
+	if (passes > room)
+		passes = room;
 
-		case 0x68:
-			cpu->registers.L = cpu->registers.B;
-			cpu->registers.pc += 1;
-			break;
+	cpu->cycles += passes * block->cycles;
 
-		case 0x69:
-			cpu->registers.L = cpu->registers.C;
-			cpu->registers.pc += 1;
-			break;
+	return executed + passes * block->count;
+}
 
-		case 0x6a:
-			cpu->registers.L = cpu->registers.D;
-			cpu->registers.pc += 1;
-			break;
+/* Whether length bytes from start read through the page table, shared or not, or for a store, are own RAM at their offset of cpu->memory holding no decoded code */
+static bool plain_memory(Cpu8080 *cpu, uint16_t start, uint32_t length, bool store)
+{
+	if (start + length > TOTAL_MEMORY_SIZE)
+		return false;
 
-		case 0x6b:
-			cpu->registers.L = cpu->registers.E;
-			cpu->registers.pc += 1;
-			break;
+	for (uint32_t page = start >> MEMORY_PAGE_SHIFT; page <= (start + length - 1) >> MEMORY_PAGE_SHIFT; page++)
+	{
+		if (!store)
+		{
+			if (!page_is_direct(&cpu->memory_map, page << MEMORY_PAGE_SHIFT))
+				return false;
 
-		case 0x6c:
-			cpu->registers.L = cpu->registers.H;
-			cpu->registers.pc += 1;
-			break;
+			continue;
+		}
 
-		case 0x6d:
-			cpu->registers.L = cpu->registers.L;
-			cpu->registers.pc += 1;
-			break;
+		// a shared page's bytes are not at cpu->memory until a store copies them
+		if (cpu->memory_map.type[page] != PAGE_RAM || cpu->memory_map.shared[page])
+			return false;
 
-		case 0x6e:
-			cpu->registers.L = cpu->memory[address];
-			cpu->registers.pc += 1;
-			break;
+		if ((cpu->block_cache && cpu->block_cache->code_pages[page]) || (cpu->jit && cpu->jit->code_pages[page]))
+			return false;
+	}
 
-		case 0x6f:
-			cpu->registers.L = cpu->registers.A;
-			cpu->registers.pc += 1;
-			break;
+	return true;
+}
 
-		case 0x70:
-			cpu->memory[address] = cpu->registers.B;
-			cpu->registers.pc += 1;
-			break;
+/* Copy length bytes read through the page table from source to memory at target */
+static void copy_plain_memory(Cpu8080 *cpu, uint16_t target, uint16_t source, uint32_t length)
+{
+	while (length)
+	{
+		uint32_t chunk = MEMORY_PAGE_SIZE - (source & MEMORY_PAGE_MASK);
 
-		case 0x71:
-			cpu->memory[address] = cpu->registers.C;
-			cpu->registers.pc += 1;
-			break;
+		if (chunk > length)
+			chunk = length;
 
-		case 0x72:
-			cpu->memory[address] = cpu->registers.D;
-			cpu->registers.pc += 1;
-			break;
+		memmove(&cpu->memory[target], &cpu->memory_map.read[source >> MEMORY_PAGE_SHIFT][source & MEMORY_PAGE_MASK], chunk);
+		target += chunk;
+		source += chunk;
+		length -= chunk;
+	}
+}
 
-		case 0x73:
-			cpu->memory[address] = cpu->registers.E;
-			cpu->registers.pc += 1;
-			break;
+/*
+ * Loop idioms.
+ *
+ * A block marked with an Idiom is a whole copy, fill or compare loop. The
+ * passes that would complete before the next event (and within budget) are
+ * done as one copy/memset()/compare over guest memory, leaving the
+ * registers, lazy flags, cycles and pc the last of them would have. Returns
+ * 0, and the loop is run as usual, when not even one pass fits or the
+ * memory involved is not plain: readable, and own RAM where it is stored to.
+ */
+static uint64_t run_idiom(Cpu8080 *cpu, const Block *block, uint64_t budget)
+{
+	Registers *r = &cpu->registers;
+	uint16_t exit = block->start + block->size;
+	uint32_t cycles = block->cycles;
+	uint32_t count = block->count;
+	uint8_t limit = (uint8_t)block->ops[3].operand;    // CPI operand of IDIOM_FILL_TO_H
+	uint32_t passes;
+
+	if (block->idiom == IDIOM_COMPARE)
+	{
+		uint8_t tail[IDIOM_COMPARE_TAIL_SIZE];
 
-		case 0x74:
-			cpu->memory[address] = cpu->registers.H;
-			cpu->registers.pc += 1;
-			break;
+		for (unsigned i = 0; i < IDIOM_COMPARE_TAIL_SIZE; i++)
+			tail[i] = read_memory(cpu, exit + i);
 
-		case 0x75:
-			cpu->memory[address] = cpu->registers.L;
-			cpu->registers.pc += 1;
-			break;
+		if (!idiom_compare_tail(tail, block->start))
+			return 0;
 
-		case 0x76:
-			HLT();
-			break;
+		cycles += INSTRUCTION_CYCLES[0x23] + INSTRUCTION_CYCLES[0x13] + INSTRUCTION_CYCLES[0x05] + INSTRUCTION_CYCLES[0xC2];
+		count += 4;
+		exit += IDIOM_COMPARE_TAIL_SIZE;
+	}
 
-		case 0x77:
-			cpu->memory[address] = *A;
-			cpu->registers.pc += 1;
-			break;
+	// passes until the loop ends by itself...
+	if (block->idiom == IDIOM_FILL_TO_H)
+	{
+		// the test follows INX H, so the first pass can end it even with H == limit already
+		if ((uint16_t)(r->HL + 1) >> 8 == limit)
+			passes = 1;
+		else
+			passes = (uint16_t)((limit << 8) - r->HL);
+	}
+	else
+		passes = r->B ? r->B : 0x100;
 
-		 case 0x78:
-			*A = *B;
-			cpu->registers.pc += 1;
-			break;
+	// ...cut to those emulate_blocks() would run before the next event
+	if (cpu->scheduler.next <= cpu->cycles)
+		return 0;
 
-		case 0x79:
-			*A = *C;
-			cpu->registers.pc += 1;
-			break;
+	if ((cpu->scheduler.next - cpu->cycles - 1) / cycles < passes)
+		passes = (cpu->scheduler.next - cpu->cycles - 1) / cycles;
 
-		case 0x7A:
-			*A = *D;
-			cpu->registers.pc += 1;
-			break;
+	if (budget / count < passes)
+		passes = budget / count;
 
-		case 0x7B:
-			*A = *E;
-			cpu->registers.pc += 1;
-			break;
+	if (passes == 0)
+		return 0;
 
-		case 0x7C:
-			*A = *H;
-			cpu->registers.pc += 1;
-			break;
+	bool reads = block->idiom == IDIOM_COPY || block->idiom == IDIOM_COMPARE;
 
-		case 0x7D:
-			*A = *L;
-			cpu->registers.pc += 1;
-			break;
+	if (!plain_memory(cpu, r->HL, passes, block->idiom != IDIOM_COMPARE) ||
+		(reads && !plain_memory(cpu, r->DE, passes, false)))
+		return 0;
 
-		case 0x7E:
-			*A = cpu->memory[address];
-			cpu->registers.pc += 1;
-			break;
-			
-		case 0x7F:
-			*A = *A;
-			cpu->registers.pc += 1;
-			break;
+	uint8_t *memory = cpu->memory;
+	const MemoryMap *map = &cpu->memory_map;
 
-		// ADDs
-		case 0x80:
-			ADD(cpu, *B);
-			break;
+	switch (block->idiom)
+	{
+		case IDIOM_COPY:
+			// a byte loop only differs from memmove() when it writes ahead of where it reads
+			if (r->HL > r->DE && r->HL < r->DE + passes)
+				return 0;
 
-		case 0x81:
-			ADD(cpu, *C);
+			copy_plain_memory(cpu, r->HL, r->DE, passes);
+			r->A = direct_byte(map, r->DE + passes - 1);
+			r->DE += passes;
 			break;
 
-		case 0x82:
-			ADD(cpu, *D);
+		case IDIOM_FILL:
+			memset(&memory[r->HL], r->A, passes);
 			break;
 
-		case 0x83:
-			ADD(cpu, *E);
+		case IDIOM_FILL_IMMEDIATE:
+		case IDIOM_FILL_TO_H:
+			memset(&memory[r->HL], (uint8_t)block->ops[0].operand, passes);
 			break;
 
-		case 0x84:
-			ADD(cpu, *H);
-			break;
+		case IDIOM_COMPARE:
+		{
+			// the first pass over a difference leaves through the head's JNZ, the interpreter takes it
+			uint32_t same = 0;
 
-		case 0x85:
-			ADD(cpu, *L);
-			break;
+			while (same < passes && direct_byte(map, r->DE + same) == direct_byte(map, r->HL + same))
+				same++;
 
-		case 0x86:
-		{
-			uint8_t value = cpu->memory[address];
+			if (same == 0)
+				return 0;
 
-			ADD(cpu, value);
+			passes = same;
+			r->A = direct_byte(map, r->DE + passes - 1);
+			set_carry(cpu, false);
+			r->DE += passes;
 			break;
 		}
+	}
 
-		case 0x87:
-			ADD(cpu, *A);
-			break;
-
-		// ADCs
-		case 0x88:
-			ADC(cpu, *B);
-			break;
+	r->HL += passes;
 
-		case 0x89:
-			ADC(cpu, *C);
-			break;
+	if (block->idiom == IDIOM_FILL_TO_H)
+	{
+		r->A = r->H;
+		sub_byte(cpu, r->A, limit, 0);
+		r->pc = (r->H == limit) ? exit : block->start;
+	}
+	else
+	{
+		r->B -= passes;
+		defer_flags(cpu, FLAGS_SUB, r->B + 1, 0, r->B);
+		r->pc = r->B ? block->start : exit;
+	}
 
-		case 0x8a:
-			ADC(cpu, *D);
-			break;
+	cpu->cycles += passes * cycles;
 
-		case 0x8b:
-			ADC(cpu, *E);
-			break;
+	return passes * count;
+}
 
-		case 0x8c:
-			ADC(cpu, *H);
-			break;
+#if PAIR_PROFILE
+/* Count the adjacent opcodes of a block run, the candidates for superinstructions */
+static void profile_pairs(Cpu8080 *cpu, const Block *block)
+{
+	for (unsigned i = 1; i < block->count; i++)
+		cpu->pair_counts[block->ops[i - 1].opcode << 8 | block->ops[i].opcode]++;
+}
+#endif
 
-		case 0x8d:
-			ADC(cpu, *L);
-			break;
+static uint64_t emulate_blocks(Cpu8080 *cpu, uint64_t count)
+{
+	uint64_t executed = 0;
 
-		case 0x8e:
+	while (executed < count && cpu->error_occurred != 5 && !cpu->halted)
+	{
+		if (cpu->hook_count && call_hook(cpu))
 		{
-			uint8_t value = cpu->memory[address];
-
-			ADC(cpu, value);
-			break;
+			executed++;
+			continue;
 		}
 
-		case 0x8f:
-			ADC(cpu, *A);
-			break;
+		uint16_t pc = cpu->registers.pc;
+		Block *block = block_cache_lookup(cpu->block_cache, pc);
 
-		// SUBs
-		case 0x90:
-			SUB(cpu, *B);
-			break;
-
-		case 0x91:
-			SUB(cpu, *C);
-			break;
-
-		case 0x92:
-			SUB(cpu, *D);
-			break;
-
-		case 0x93:
-			SUB(cpu, *E);
-			break;
+		if (block == NULL)
+			block = block_cache_decode(cpu->block_cache, &cpu->memory_map, pc, block_handlers);
 
-		case 0x94:
-			SUB(cpu, *H);
-			break;
-
-		case 0x95:
-			SUB(cpu, *L);
-			break;
-
-		case 0x96:
+		/*
+		 * A block retires as a unit, so one that would straddle an interrupt
+		 * point (or could not be decoded) is stepped by the interpreter.
+		 */
+		if (block == NULL || crosses_interrupt(cpu, block->taken_cycles))
 		{
-			uint8_t value = cpu->memory[address];
-
-			SUB(cpu, value);
-			break;
+			executed += emulate_instructions(cpu, 1);
+			continue;
 		}
 
-		case 0x97:
-			SUB(cpu, *A);
-			break;
-
-		// SBBs
-		case 0x98:
-			SBB(cpu, *B);
-			break;
-
-		case 0x99:
-			SBB(cpu, *C);
-			break;
-
-		case 0x9a:
-			SBB(cpu, *D);
-			break;
-
-		case 0x9b:
-			SBB(cpu, *E);
-			break;
-
-		case 0x9c:
-			SBB(cpu, *H);
-			break;
+		if (block->spin)
+		{
+			executed += run_spin(cpu, block, count - executed);
+			external_dev_routine(cpu);
+			continue;
+		}
 
-		case 0x9d:
-			SBB(cpu, *L);
-			break;
+		if (block->idiom)
+		{
+			uint64_t ran = run_idiom(cpu, block, count - executed);
 
-		case 0x9e:
+			if (ran)
 			{
-				uint8_t value = cpu->memory[address];
-
-				SBB(cpu, value);
-				break;
+				executed += ran;
+				external_dev_routine(cpu);
+				continue;
 			}
-
-		case 0x9f:
-			SBB(cpu, *A);
-			break;
-
-		// ANAs
-		case 0xa0:
-			ANA(cpu, *B);
-			break;
-
-		case 0xa1:
-			ANA(cpu, *C);
-			break;
-
-		case 0xa2:
-			ANA(cpu, *D);
-			break;
-
-		case 0xa3:
-			ANA(cpu, *E);
-			break;
-
-		case 0xa4:
-			ANA(cpu, *H);
-			break;
-
-		case 0xa5:
-			ANA(cpu, *L);
-			break;
-
-		case 0xa6:
-		{
-			uint8_t value = cpu->memory[address];
-
-			ANA(cpu, value);
-			break;
 		}
 
-		case 0xA7:
-			ANA(cpu, *A);
-			break;
-
-		// XRAs
-		case 0xA8:
-			XRA(cpu, *B);
-			break;
+		const void *code = cpu->jit ? translated_block(cpu, block) : NULL;
 
-		case 0xA9:
-			XRA(cpu, *C);
-			break;
-
-		case 0xAA:
-			XRA(cpu, *D);
-			break;
-
-		case 0xAB:
-			XRA(cpu, *E);
-			break;
-
-		case 0xAC:
-			XRA(cpu, *H);
-			break;
-
-		case 0xAD:
-			XRA(cpu, *L);
-			break;
-
-		case 0xAE:
+		if (code)
+			executed += run_translated(cpu, code, count - executed);
+		else
 		{
-			uint8_t value = cpu->memory[address];
+			uint64_t ran = execute_block(cpu, block);
 
-			XRA(cpu, value);
-			break;
-		}
+			executed += ran;
+			// a store into the block evicted it, stopping it after the store
+			cpu->cycles += block->count ? block->cycles : block_cycles(block, ran);
 
-		case 0xAF:
-			XRA(cpu, *A);
-			break;
+#if PAIR_PROFILE
+			profile_pairs(cpu, block);
+#endif
+		}
 
-		// ORAs
-		case 0xB0:
-			ORA(cpu, &cpu->registers.B);
-			break;
+		external_dev_routine(cpu);
+	}
 
-		case 0xB1:
-			ORA(cpu, &cpu->registers.C);
-			break;
+	return executed;
+}
 
-		case 0xB2:
-			ORA(cpu, &cpu->registers.D);
-			break;
+#ifdef AOT_ROM
+/* Whether rom holds the image tools/aot8080.c translated, at the same address; the Makefile's AOT_ROM need not be ROM_FILE */
+static bool rom_translated(const RomImage *rom)
+{
+	// the store's images are read-only, each is compared once per thread
+	static _Thread_local const RomImage *checked;
+	static _Thread_local bool matches;
 
-		case 0xB3:
-			ORA(cpu, &cpu->registers.E);
-			break;
+	if (rom == checked)
+		return matches;
 
-		case 0xB4:
-			ORA(cpu, &cpu->registers.H);
-			break;
+	checked = rom;
+	matches = true;
 
-		case 0xB5:
-			ORA(cpu, &cpu->registers.L);
-			break;
+	for (uint32_t address = aot_image_start; address < aot_image_end && matches; address++)
+	{
+		// wraps past the image for addresses below ROM_LOAD_ADDRESS
+		uint32_t offset = address - ROM_LOAD_ADDRESS;
 
-		case 0xB6:
-		{
-			uint8_t value = cpu->memory[address];
+		matches = offset < rom->size &&
+				  rom->pages[offset >> MEMORY_PAGE_SHIFT]->bytes[offset & MEMORY_PAGE_MASK] == aot_image[address - aot_image_start];
+	}
 
-			ORA(cpu, &value);
-			break;
-		}
+	if (!matches)
+		fprintf(stderr, "ROM differs from the image translated ahead of time, interpreting it\n");
 
-		case 0xB7:
-			ORA(cpu, &cpu->registers.A);
-			break;
+	return matches;
+}
 
-		// CMPs
-		case 0xB8:
-			CMP(cpu, cpu->registers.B);
-			break;
+/* Run the ROM translated by tools/aot8080.c, interpreting whatever it does not cover */
+static uint64_t emulate_aot(Cpu8080 *cpu, uint64_t count)
+{
+	uint64_t executed = 0;
+	bool translated = cpu->rom && rom_translated(cpu->rom);
 
-		case 0xB9:
-			CMP(cpu, cpu->registers.C);
-			break;
+	while (executed < count && cpu->error_occurred != 5 && !cpu->halted)
+	{
+		resolve_flags(cpu);
 
-		case 0xBA:
-			CMP(cpu, cpu->registers.D);
-			break;
+		// translated ROM code goes from routine to routine without looking for hooks
+		uint64_t ran = cpu->hook_count || !translated ? 0 : aot_run(cpu, next_interrupt(cpu), count - executed);
 
-		case 0xBB:
-			CMP(cpu, cpu->registers.E);
-			break;
+		if (ran == 0)
+			ran = cpu->block_cache ? emulate_blocks(cpu, 1) : emulate_instructions(cpu, 1);
 
-		case 0xBC:
-			CMP(cpu, cpu->registers.H);
-			break;
+		executed += ran;
+	}
 
-		case 0xBD:
-			CMP(cpu, cpu->registers.L);
-			break;
+	return executed;
+}
+#endif
 
-		case 0xBE:
-		{
-			uint8_t value = cpu->memory[address];
+void set_breakpoint(Cpu8080 *cpu, uint16_t address)
+{
+	if (cpu->breakpoints == NULL)
+	{
+		cpu->breakpoints = (bool*)calloc(TOTAL_MEMORY_SIZE, sizeof(bool));
 
-			CMP(cpu, value);
-			break;
+		if (! cpu->breakpoints) {
+			fprintf(stderr, "Error allocating breakpoints: %s\n", strerror(errno));
+			exit(EXIT_FAILURE);
 		}
+	}
 
-		case 0xBF:
-			CMP(cpu, cpu->registers.A);
-			break;
-
-		case 0xC0:
-			RNZ(cpu);
-			break;
+	if (!cpu->breakpoints[address])
+	{
+		cpu->breakpoints[address] = true;
+		cpu->breakpoint_count++;
+	}
+}
 
-		case 0xC1:
-			POP(cpu, &cpu->registers.B, &cpu->registers.C);
-			break;
+void clear_breakpoint(Cpu8080 *cpu, uint16_t address)
+{
+	if (cpu->breakpoints && cpu->breakpoints[address])
+	{
+		cpu->breakpoints[address] = false;
+		cpu->breakpoint_count--;
+	}
+}
 
-		case 0xC2:
-			JNZ(cpu);
-			break;
+/* Execute about cycles cycles on the fastest engine available, returns the instructions run */
+static inline uint64_t run_batch(Cpu8080 *cpu, uint64_t cycles)
+{
+	// never overshoot by more than one instruction or block
+	uint64_t count = cycles / MAX_INSTRUCTION_CYCLES + 1;
 
-		case 0xC3:
-			JMP(cpu);	
-			break;
+#ifdef AOT_ROM
+	return emulate_aot(cpu, count);
+#else
+	if (cpu->block_cache)
+		return emulate_blocks(cpu, count);
+	else
+		return emulate_instructions(cpu, count);
+#endif
+}
 
-		case 0xC4:
-			CNZ(cpu);
-			break;
+/*
+ * A halted CPU only waits for an interrupt, so skip straight to the next
+ * event, or to end if none is due before it. Returns false when interrupts
+ * are disabled and nothing can resume it.
+ */
+static bool wait_halted(Cpu8080 *cpu, uint64_t end)
+{
+	if (!cpu->interrupt_enabled)
+		return false;
 
-		case 0xC5:
-			PUSH(cpu, cpu->registers.B, cpu->registers.C);
-			break;
-	   
-		case 0xC6:
-			ADI(cpu);
-			break;
-		
-		case 0xC7:
-			RST(cpu, 0);
-			break;
+	cpu->cycles = (cpu->scheduler.next < end) ? cpu->scheduler.next : end;
 
-		case 0xC8:
-			RZ(cpu);
-			break;
+	if (cpu->cycles >= cpu->scheduler.next)
+		scheduler_run(&cpu->scheduler, cpu, cpu->cycles);
 
-		case 0xC9:
-			RET(cpu);
-			break;
+	external_dev_routine(cpu);
 
-		case 0xCA:
-			JZ(cpu);
-			break;
+	return true;
+}
 
-		case 0xCC:
-			CZ(cpu);
-			break;
-		
-		case 0xCD: 
-			CALL_adr(cpu);
-			break;
-		
-		case 0xCE:
-			ACI(cpu);	
-			break;
+RunResult run_cycles(Cpu8080 *cpu, uint64_t budget)
+{
+	uint64_t start = cpu->cycles;
+	uint64_t end = start + budget;
+	RunResult result = { 0, 0, STOP_BUDGET };
 
-		case 0xCF:
-			RST(cpu, 1);
-			break;
+	while (cpu->cycles < end)
+	{
+		if (cpu->halted)
+		{
+			if (!wait_halted(cpu, end))
+			{
+				result.reason = STOP_HALT;
+				break;
+			}
 
-		case 0xD0:
-			RNC(cpu);
-			break;
+			continue;
+		}
 
-		case 0xD1:
-			POP(cpu, &cpu->registers.D, &cpu->registers.E);
-			break;
+		if (cpu->hook_count && call_hook(cpu))
+		{
+			result.instructions++;
+			continue;
+		}
 
-		case 0xD2:
-			JNC(cpu);
-			break;
-		
-		case 0xD3:
-			OUT(cpu);
-			break;
+		/*
+		 * With breakpoints set, step one instruction at a time; the one at
+		 * registers.pc on entry always runs so a stopped CPU can resume.
+		 */
+		if (cpu->breakpoint_count)
+		{
+			if (cpu->breakpoints[cpu->registers.pc & 0xFFFF] && cpu->cycles != start)
+			{
+				result.reason = STOP_BREAKPOINT;
+				break;
+			}
 
-		case 0xD4:
-			CNC(cpu);
-			break;
+			result.instructions += emulate_instructions(cpu, 1);
+		}
+		else
+			result.instructions += run_batch(cpu, end - cpu->cycles);
 
-		case 0xD5:
-			PUSH(cpu, cpu->registers.D, cpu->registers.E);
+		if (cpu->error_occurred == 5)
+		{
+			result.reason = STOP_UNIMPLEMENTED;
 			break;
+		}
+	}
 
-		case 0xD6:
-			SUI(cpu);
-			break;
+	result.cycles = cpu->cycles - start;
 
-		case 0xD7:
-			RST(cpu, 2);
-			break;
+	return result;
+}
 
-		case 0xD8:
-			RC(cpu);
-			break;
+void set_hook(Cpu8080 *cpu, uint16_t address, NativeHook hook, void *context)
+{
+	if (cpu->hook_bitmap == NULL)
+	{
+		cpu->hook_bitmap = (uint64_t*)calloc(TOTAL_MEMORY_SIZE / 64, sizeof(uint64_t));
 
-		case 0xDA:
-			JC(cpu);
-			break;
+		if (! cpu->hook_bitmap) {
+			fprintf(stderr, "Error allocating hooks: %s\n", strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+	}
 
-		case 0xDB:
-			IN(cpu);
-			break;
-		
-		case 0xDC:
-			CC(cpu);
-			break;
-		
-		case 0xDE:
-			SBI(cpu);
-			break;
+	clear_hook(cpu, address);
 
-		case 0xDF:
-			RST(cpu, 3);
-			break;
-		
-		case 0xE0:
-			RPO(cpu);
-			break;
+	Hook *hooks = (Hook*)realloc(cpu->hooks, (cpu->hook_count + 1) * sizeof(Hook));
 
-		case 0xE1:
-			POP(cpu, &cpu->registers.H, &cpu->registers.L);
-			break;
-		
-		case 0xE2:
-			JPO(cpu);
-			break;
-		
-		case 0xE3:
-			XTHL(cpu);
-			break;
+	if (! hooks) {
+		fprintf(stderr, "Error allocating hooks: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
 
-		case 0xE4:
-			CPO(cpu);
-			break;
+	cpu->hooks = hooks;
+	cpu->hooks[cpu->hook_count++] = (Hook){ address, hook, context };
+	cpu->hook_bitmap[address >> 6] |= 1ull << (address & 63);
 
-		case 0xE5:
-			PUSH(cpu, cpu->registers.H, cpu->registers.L);
-			break;
-		
-		case 0xE6:
-			ANI(cpu);
-			break;
+	// translated code may already jump straight into the routine
+	if (cpu->jit)
+		jit_flush(cpu->jit);
+}
 
-		case 0xE7:
-			RST(cpu, 4);
-			break;
+void clear_hook(Cpu8080 *cpu, uint16_t address)
+{
+	if (cpu->hook_bitmap == NULL || !is_hooked(cpu, address))
+		return;
 
-		case 0xE8:
-			RPE(cpu);
-			break;
-		
-		case 0xE9:
-			PCHL(cpu);
+	for (unsigned i = 0; i < cpu->hook_count; i++)
+	{
+		if (cpu->hooks[i].address == address)
+		{
+			cpu->hooks[i] = cpu->hooks[--cpu->hook_count];
 			break;
+		}
+	}
 
-		case 0xEA:
-			JPE(cpu);
-			break;
+	cpu->hook_bitmap[address >> 6] &= ~(1ull << (address & 63));
+}
 
-		case 0xEB:	
-			XCHG(cpu);
-			break;
+/* malloc()ed copy of size bytes, NULL for NULL or nothing to copy */
+static void* duplicate(const void *source, size_t size)
+{
+	if (source == NULL || size == 0)
+		return NULL;
 
-		case 0xEC:	
-			CPE(cpu);
-			break;
-		
-		case 0xEE:
-			XRI(cpu);
-			break;
+	void *copy = malloc(size);
 
-		case 0xEF:
-			RST(cpu, 5);
-			break;
-		
-		case 0xF0:
-			RP(cpu);
-			break;
+	if (! copy) {
+		fprintf(stderr, "Error cloning CPU: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
 
-		case 0xF1:
-			POP_PSW(cpu);
-			break;
+	return memcpy(copy, source, size);
+}
 
-		case 0xF2:
-			JP(cpu);
-			break;
+Cpu8080* clone_cpu(Cpu8080 *parent)
+{
+	Cpu8080 *cpu = (Cpu8080*)aligned_alloc(_Alignof(Cpu8080), sizeof(Cpu8080));
 
-		case 0xF3:
-			DI(cpu);
-			break;	
+	if (!cpu) {
+		fprintf(stderr, "Error allocating memory for CPU: %s\n", strerror(errno));
+		exit(EXIT_FAILURE);
+	}
 
-		case 0xF4:
-			CP(cpu);
-			break;
-		
-		case 0xF5:
-			PUSH_PSW(cpu);	
-			break;
-		
-		case 0xF6:
-			ORI(cpu);
-			break;
-		
-		case 0xF7:
-			RST(cpu, 6);
-			break;
+	// cpu->memory is left untouched, every page with a meaning is shared
+	memory_map_share(&parent->memory_map, &cpu->memory_map, cpu->memory);
+
+	cpu->registers = parent->registers;
+	cpu->interrupt_enabled = parent->interrupt_enabled;
+	cpu->halted = parent->halted;
+	cpu->cycles = parent->cycles;
+	cpu->scheduler = parent->scheduler;
+	memcpy(cpu->io_data, parent->io_data, sizeof(cpu->io_data));
+	cpu->error_occurred = parent->error_occurred;
+	cpu->rom = parent->rom ? acquire_rom() : NULL;
+
+	cpu->breakpoints = (bool*)duplicate(parent->breakpoints, TOTAL_MEMORY_SIZE * sizeof(bool));
+	cpu->breakpoint_count = parent->breakpoint_count;
+	cpu->hook_bitmap = (uint64_t*)duplicate(parent->hook_bitmap, TOTAL_MEMORY_SIZE / 8);
+	cpu->hooks = (Hook*)duplicate(parent->hooks, parent->hook_count * sizeof(Hook));
+	cpu->hook_count = parent->hook_count;
+	cpu->pair_counts = NULL;
+
+	// a block cache alone is larger than many clones, they are interpreted
+	cpu->block_cache = NULL;
+	cpu->jit = NULL;
 
-		case 0xF8:
-			RM(cpu);
-			break;
-		
-		case 0xF9:
-			SPHL(cpu);
-			break;
-		
-		case 0xFA:
-			JM(cpu);
-			break;
-		
-		case 0xFB:
-			EI(cpu);
-			break;	
+	return cpu;
+}
 
-		case 0xFC:
-			CM(cpu);
-			break;
+static void enable_engines(Cpu8080 *cpu)
+{
+	if (BLOCK_CACHE_ON)
+		enable_block_cache(cpu);
 
-		case 0xFE:
-			CPI(cpu);
-			break;
+	// translated code would bypass the pair profile
+	if (BLOCK_CACHE_ON && JIT_ON && !PAIR_PROFILE)
+		enable_jit(cpu);
+}
 
-		case 0xFF:
-			RST(cpu, 7);
-			break;
+void load_machine(Cpu8080 *cpu)
+{
+	load_rom(cpu);
+	enable_engines(cpu);
+}
 
-		default:
-			printf("Unimplemented instruction: 0x%02X\n", instruction);
-			error_occurred = 5;
-			break;
-	}
+RunResult intel8080_headless(Cpu8080 *cpu, uint64_t cycle_limit)
+{
+	RunResult total = { 0, 0, STOP_BUDGET };
 
-	uint8_t instruction_cycles = INSTRUCTION_CYCLES[instruction];
+	load_machine(cpu);
 
-	for (int i = 0; i < instruction_cycles; i++)
+	while (total.cycles < cycle_limit)
 	{
-		cpu->cycles += 1;
-		if (cpu->interrupt_enabled)
+		RunResult result = run_cycles(cpu, cycle_limit - total.cycles);
+
+		total.cycles += result.cycles;
+		total.instructions += result.instructions;
+
+		if (result.reason == STOP_UNIMPLEMENTED || result.reason == STOP_HALT)
 		{
-			vblank_irq(cpu);
-			timer_irq(cpu);
+			total.reason = result.reason;
+			break;
 		}
-
 	}
 
-	external_dev_routine();
-
-	return instruction_cycles;
+	return total;
 }
 
-static inline void load_and_initialize(Cpu8080 *cpu) 
+#ifndef HEADLESS
+static inline void load_and_initialize(Cpu8080 *cpu, Screen *screen) 
 {
 	load_rom(cpu);
-	load_rom_to_memory(cpu);
-	buffer_to_screen(cpu);
-	update_screen();
+	buffer_to_screen(screen, cpu);
+	update_screen(screen);
 }
 
 static inline void handle_sdl_events(int *running) 
@@ -2235,26 +2172,32 @@ static inline void handle_sdl_events(int *running)
 	}
 }
 
-void intel8080_main(Cpu8080 *cpu)
+void intel8080_main(Cpu8080 *cpu, Screen *screen)
 {
 	int running = 1;
-	load_and_initialize(cpu);
+	load_and_initialize(cpu, screen);
+	enable_engines(cpu);
 
 	const uint32_t frame_interval = 50; // 50 ms = 20 FPS
-	uint32_t next_frame_time = SDL_GetTicks() + frame_interval;
+	uint32_t start_time = SDL_GetTicks();
+	uint32_t next_frame_time = start_time + frame_interval;
+	uint64_t frames = 0;
 
-	while (running && error_occurred != 5)
+	while (running)
 	{
 		handle_sdl_events(&running);
 
-		uint8_t instruction_cycles = emulate_instruction(cpu);
+		RunResult result = run_cycles(cpu, CYCLES_PER_FRAME);
+
+		if (result.reason == STOP_UNIMPLEMENTED)
+			break;
 
 		uint32_t now = SDL_GetTicks();
 
 		if (now >= next_frame_time)
 		{
-			buffer_to_screen(cpu);
-			update_screen();
+			buffer_to_screen(screen, cpu);
+			update_screen(screen);
 
 			next_frame_time += frame_interval;
 
@@ -2262,5 +2205,21 @@ void intel8080_main(Cpu8080 *cpu)
 				next_frame_time = now + frame_interval;
 			}
 		}
+
+		/*
+		 * Keep to real time. Busy-waits and HLT are skipped in a fraction of
+		 * the host time they stand for, the rest is slept instead of spun.
+		 */
+		uint32_t due = start_time + (uint32_t)(++frames * 1000 / TARGET_FPS);
+
+		if (due > now)
+			SDL_Delay(due - now);
+		else if (now - due > 100)
+		{
+			// too far behind to catch up, drop the backlog
+			start_time = now;
+			frames = 0;
+		}
 	}
-}
\ No newline at end of file
+}
+#endif
@@ -0,0 +1,1041 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <jit.h>
+#include <cpu.h>
+
+#if defined(__x86_64__) && defined(__unix__)
+#define JIT_SUPPORTED
+#include <sys/mman.h>
+#endif
+
+/*
+ * x86-64 translation of cached blocks.
+ *
+ * While translated code runs the guest A, HL and flags live in callee-saved
+ * host registers and the other registers stay in the Cpu8080. Moves, loads,
+ * 16-bit register arithmetic and jumps are emitted inline; everything else
+ * (ALU, stack, I/O) calls back into the interpreter for that one instruction
+ * with the cached registers written back around the call. Stores go through
+ * the interpreter's write_memory() so code invalidation still sees them.
+ *
+ * Every block starts by checking that it fits before the next interrupt and
+ * within the caller's instruction budget, then retires all its cycles and
+ * instructions at once; early exits give back what did not run. Exits to a
+ * statically known PC are patched into direct jumps once the target block is
+ * translated, so hot loops run without returning to the dispatcher.
+ *
+ * The arena is never writable and executable at once: it is mapped
+ * read/execute and made read/write only while code is emitted or exits are
+ * patched, which a store from translated code may do before it returns.
+ */
+
+typedef struct JitRun {
+    uint64_t cycle_limit;   // first cycle count a block may not reach
+    uint64_t budget;        // instructions
+    uint64_t executed;
+} JitRun;
+
+#ifdef JIT_SUPPORTED
+
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+/* Host registers reserved while translated code runs */
+#define REG_CPU     RBP
+#define REG_MEMORY  RBX     // cpu->memory_map.read
+#define REG_A       R12
+#define REG_HL      R13     // H in bits 8-15
+#define REG_F       R14     // F byte
+#define REG_RUN     R15
+
+#define CPU_FIELD(field) ((int32_t)offsetof(Cpu8080, field))
+#define RUN_FIELD(field) ((int32_t)offsetof(JitRun, field))
+
+/* 8080 register field encoding: B C D E H L M A */
+#define GUEST_M 6
+#define GUEST_A 7
+
+static const int32_t REGISTER_OFFSET[8] = {
+    CPU_FIELD(registers.B), CPU_FIELD(registers.C), CPU_FIELD(registers.D), CPU_FIELD(registers.E),
+    CPU_FIELD(registers.H), CPU_FIELD(registers.L), -1, CPU_FIELD(registers.A)
+};
+
+/* Register pair encoding: BC DE HL */
+static const int32_t PAIR_OFFSET[3] = {
+    CPU_FIELD(registers.BC), CPU_FIELD(registers.DE), CPU_FIELD(registers.HL)
+};
+
+typedef struct Emitter {
+    uint8_t *code;
+    uint8_t *end;
+} Emitter;
+
+/* Writes past the end are dropped; the caller checks overflowed() once at the end */
+static inline void emit8(Emitter *e, uint8_t byte)
+{
+    if (e->code < e->end)
+        *e->code = byte;
+    e->code++;
+}
+
+static inline bool overflowed(const Emitter *e)
+{
+    return e->code > e->end;
+}
+
+static void emit32(Emitter *e, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        emit8(e, value >> (8 * i));
+}
+
+static void emit64(Emitter *e, uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+        emit8(e, value >> (8 * i));
+}
+
+static void emit_opcode(Emitter *e, unsigned opcode)
+{
+    if (opcode > 0xFF)
+        emit8(e, opcode >> 8);
+    emit8(e, opcode & 0xFF);
+}
+
+static void emit_rex(Emitter *e, bool wide, int reg, int base)
+{
+    uint8_t rex = 0x40 | (wide << 3) | ((reg & 8) >> 1) | ((base & 8) >> 3);
+
+    if (rex != 0x40)
+        emit8(e, rex);
+}
+
+/* op reg, rm (reg may also be a /digit opcode extension) */
+static void emit_rr(Emitter *e, bool wide, unsigned opcode, int reg, int rm)
+{
+    emit_rex(e, wide, reg, rm);
+    emit_opcode(e, opcode);
+    emit8(e, 0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+/* op reg, [base + disp]; base is never rsp/r12, which would need a SIB byte */
+static void emit_rm(Emitter *e, bool wide, unsigned opcode, int reg, int base, int32_t disp)
+{
+    emit_rex(e, wide, reg, base);
+    emit_opcode(e, opcode);
+
+    if (disp == 0 && (base & 7) != RBP)
+        emit8(e, (reg & 7) << 3 | (base & 7));
+    else if (disp >= -128 && disp <= 127)
+    {
+        emit8(e, 0x40 | (reg & 7) << 3 | (base & 7));
+        emit8(e, (uint8_t)disp);
+    }
+    else
+    {
+        emit8(e, 0x80 | (reg & 7) << 3 | (base & 7));
+        emit32(e, (uint32_t)disp);
+    }
+}
+
+static void emit_mov_imm(Emitter *e, int reg, uint32_t value)
+{
+    emit_rex(e, false, 0, reg);
+    emit8(e, 0xB8 + (reg & 7));
+    emit32(e, value);
+}
+
+static void emit_shift(Emitter *e, int reg, int digit, uint8_t count)
+{
+    emit_rr(e, false, 0xC1, digit, reg);
+    emit8(e, count);
+}
+
+#define emit_shl(e, reg, count) emit_shift(e, reg, 4, count)
+#define emit_shr(e, reg, count) emit_shift(e, reg, 5, count)
+
+static void emit_and_imm(Emitter *e, int reg, uint32_t value)
+{
+    emit_rr(e, false, 0x81, 4, reg);
+    emit32(e, value);
+}
+
+static void emit_call(Emitter *e, uintptr_t function)
+{
+    emit_rr(e, true, 0x89, REG_CPU, RDI);          // mov rdi, rbp
+    emit8(e, 0x48);                                 // mov rax, imm64
+    emit8(e, 0xB8);
+    emit64(e, function);
+    emit_rr(e, false, 0xFF, 2, RAX);               // call rax
+}
+
+/* jmp/jcc rel32, returns the displacement field to patch */
+static uint8_t* emit_jump(Emitter *e, unsigned opcode)
+{
+    emit_opcode(e, opcode);
+    uint8_t *field = e->code;
+    emit32(e, 0);
+    return field;
+}
+
+#define JMP 0xE9
+#define JZ  0x0F84
+#define JNZ 0x0F85
+#define JAE 0x0F83
+
+static void set_jump(uint8_t *field, const uint8_t *target)
+{
+    int32_t rel = (int32_t)(target - (field + 4));
+    memcpy(field, &rel, sizeof(rel));
+}
+
+/* eax = guest register r (not M) */
+static void emit_get_register(Emitter *e, int r)
+{
+    switch (r)
+    {
+        case 4:
+            emit_rr(e, false, 0x89, REG_HL, RAX);
+            emit_shr(e, RAX, 8);
+            break;
+        case 5:
+            emit_rr(e, false, 0x0FB6, RAX, REG_HL);
+            break;
+        case GUEST_A:
+            emit_rr(e, false, 0x0FB6, RAX, REG_A);
+            break;
+        default:
+            emit_rm(e, false, 0x0FB6, RAX, REG_CPU, REGISTER_OFFSET[r]);
+            break;
+    }
+}
+
+/* guest register r (not M) = al, clobbers ecx */
+static void emit_set_register(Emitter *e, int r)
+{
+    switch (r)
+    {
+        case 4:
+            emit_and_imm(e, REG_HL, 0x00FF);
+            emit_rr(e, false, 0x0FB6, RCX, RAX);
+            emit_shl(e, RCX, 8);
+            emit_rr(e, false, 0x09, RCX, REG_HL);
+            break;
+        case 5:
+            emit_and_imm(e, REG_HL, 0xFF00);
+            emit_rr(e, false, 0x0FB6, RCX, RAX);
+            emit_rr(e, false, 0x09, RCX, REG_HL);
+            break;
+        case GUEST_A:
+            emit_rr(e, false, 0x0FB6, REG_A, RAX);
+            break;
+        default:
+            emit_rm(e, false, 0x88, RAX, REG_CPU, REGISTER_OFFSET[r]);
+            break;
+    }
+}
+
+/* reg = BC (pair 0), DE (1) or HL (2) */
+static void emit_get_pair(Emitter *e, int pair, int reg)
+{
+    if (pair == 2)
+        emit_rr(e, false, 0x0FB7, reg, REG_HL);
+    else
+        emit_rm(e, false, 0x0FB7, reg, REG_CPU, PAIR_OFFSET[pair]);
+}
+
+/* BC, DE or HL in the Cpu8080 = the low word of reg */
+static void emit_store_pair(Emitter *e, int pair, int reg)
+{
+    emit8(e, 0x66);
+    emit_rm(e, false, 0x89, reg, REG_CPU, PAIR_OFFSET[pair]);
+}
+
+static void emit_spill(Emitter *e)
+{
+    emit_rm(e, false, 0x88, REG_A, REG_CPU, CPU_FIELD(registers.A));
+    emit_rm(e, false, 0x88, REG_F, REG_CPU, CPU_FIELD(registers.F));
+    emit_store_pair(e, 2, REG_HL);
+}
+
+/* Leaves eax alone so a helper's return value survives */
+static void emit_reload(Emitter *e)
+{
+    emit_rm(e, false, 0x0FB6, REG_A, REG_CPU, CPU_FIELD(registers.A));
+    emit_rm(e, false, 0x0FB6, REG_F, REG_CPU, CPU_FIELD(registers.F));
+    emit_rm(e, false, 0x0FB7, REG_HL, REG_CPU, CPU_FIELD(registers.HL));
+}
+
+static void emit_set_pc(Emitter *e, uint16_t pc)
+{
+    emit_rm(e, false, 0xC7, 0, REG_CPU, CPU_FIELD(registers.pc));
+    emit32(e, pc);
+}
+
+/* An out-of-line exit, emitted after the block body */
+typedef struct Stub {
+    uint8_t *jump;          // rel32 field branching here
+    uint16_t pc;
+    uint16_t cycles;        // retired up front but never run
+    uint8_t ops;
+    bool link;              // chain to pc rather than return
+} Stub;
+
+typedef struct Translator {
+    Jit *jit;
+    Emitter e;
+    uint16_t address;       // guest PC of the instruction being translated
+    uint16_t next;
+    uint16_t cycles;        // left in the block after this instruction
+    uint8_t ops;
+    Stub stubs[BLOCK_MAX_OPS + 4];
+    unsigned stub_count;
+    JitLink links[2];
+    unsigned link_count;
+} Translator;
+
+static void add_stub(Translator *t, uint8_t *jump, uint16_t pc, uint16_t cycles, uint8_t ops, bool link)
+{
+    t->stubs[t->stub_count++] = (Stub){ jump, pc, cycles, ops, link };
+}
+
+/* Leave for pc; jit_compile() chains the jump into pc's translation once this one is in place */
+static void emit_link(Translator *t, uint16_t pc)
+{
+    emit_set_pc(&t->e, pc);
+
+    uint8_t *field = emit_jump(&t->e, JMP);
+
+    if (overflowed(&t->e))
+        return;
+
+    set_jump(field, t->jit->exit);
+    t->links[t->link_count++] = (JitLink){ field, pc };
+}
+
+static void emit_exit(Translator *t, unsigned jump)
+{
+    uint8_t *field = emit_jump(&t->e, jump);
+
+    if (!overflowed(&t->e))
+        set_jump(field, t->jit->exit);
+}
+
+/* Leave after the current instruction if a helper reported that translated code was dropped */
+static void emit_check_invalidated(Translator *t)
+{
+    emit_rr(&t->e, false, 0x84, RAX, RAX);          // test al, al
+    add_stub(t, emit_jump(&t->e, JNZ), t->next, t->cycles, t->ops, false);
+}
+
+/* Store edx to guest address esi */
+static void emit_store(Translator *t)
+{
+    emit_call(&t->e, (uintptr_t)t->jit->store);
+    emit_check_invalidated(t);
+}
+
+/*
+ * reg = byte at guest address ecx (bits 16 and up clear), clobbers ecx and
+ * edx. The page's read pointer comes from the memory map; MMIO pages have
+ * none and call the interpreter's load instead.
+ */
+static void emit_load(Translator *t, int reg)
+{
+    Emitter *e = &t->e;
+
+    emit_rr(e, false, 0x89, RCX, RDX);              // mov edx, ecx
+    emit_shr(e, RDX, MEMORY_PAGE_SHIFT);
+    emit_rex(e, true, RDX, REG_MEMORY);             // mov rdx, [REG_MEMORY + rdx*8]
+    emit8(e, 0x8B);
+    emit8(e, (RDX & 7) << 3 | 0x04);
+    emit8(e, 0xC0 | (RDX & 7) << 3 | (REG_MEMORY & 7));
+    emit_rr(e, true, 0x85, RDX, RDX);               // test rdx, rdx
+    uint8_t *mmio = emit_jump(e, JZ);
+
+    emit_rr(e, false, 0x0FB6, RCX, RCX);            // movzx ecx, cl
+    emit_rex(e, false, reg, RDX);                   // movzx reg, byte [rdx + rcx]
+    emit_opcode(e, 0x0FB6);
+    emit8(e, (reg & 7) << 3 | 0x04);
+    emit8(e, RCX << 3 | (RDX & 7));
+    uint8_t *done = emit_jump(e, JMP);
+
+    if (!overflowed(e))
+        set_jump(mmio, e->code);
+
+    emit_rr(e, false, 0x89, RCX, RSI);              // mov esi, ecx
+    emit_call(e, (uintptr_t)t->jit->load);
+    emit_rr(e, false, 0x0FB6, reg, RAX);            // movzx reg, al
+
+    if (!overflowed(e))
+        set_jump(done, e->code);
+}
+
+static void emit_interpret(Translator *t, const MicroOp *op)
+{
+    Emitter *e = &t->e;
+
+    emit_set_pc(e, t->address);
+    emit_spill(e);
+    emit_mov_imm(e, RSI, op->opcode);
+    emit_mov_imm(e, RDX, op->operand);
+    emit_call(e, (uintptr_t)t->jit->step);
+    emit_reload(e);
+}
+
+static int mask_shift(uint8_t mask)
+{
+    int shift = 0;
+
+    while (!(mask & 1))
+    {
+        mask >>= 1;
+        shift++;
+    }
+
+    return shift;
+}
+
+/* Set z, s and p from the byte in reg, clear cy and ac; clobbers ecx */
+static void emit_set_szp(Translator *t, int reg)
+{
+    Emitter *e = &t->e;
+    uint8_t keep = (uint8_t)~FLAG_MASK;
+
+    emit8(e, 0x48);                                 // mov rcx, szp
+    emit8(e, 0xB9);
+    emit64(e, (uintptr_t)szp_flags);
+
+    if (reg & 8)                                    // movzx ecx, byte [rcx + reg]
+        emit8(e, 0x42);
+    emit_opcode(e, 0x0FB6);
+    emit8(e, RCX << 3 | 0x04);
+    emit8(e, (reg & 7) << 3 | RCX);
+
+    emit_and_imm(e, REG_F, keep);
+    emit_rr(e, false, 0x09, RCX, REG_F);
+}
+
+/* Set the flag in mask from the condition of setcc (after a cmp); clobbers edx */
+static void emit_set_flag(Emitter *e, int setcc, uint8_t mask)
+{
+    emit_rr(e, false, setcc, 0, RDX);
+    emit_rr(e, false, 0x0FB6, RDX, RDX);
+    emit_shl(e, RDX, mask_shift(mask));
+    emit_rr(e, false, 0x09, RDX, REG_F);
+}
+
+/*
+ * ANA/XRA/ORA/CMP and their immediate forms with the operand in eax,
+ * producing the same flags as the interpreter's handlers.
+ */
+static void emit_logic(Translator *t, int operation)
+{
+    Emitter *e = &t->e;
+
+    switch (operation)
+    {
+        case 0:                                     /* ANA: ac from bit 3 of A | operand */
+            emit_rr(e, false, 0x89, REG_A, RDX);
+            emit_rr(e, false, 0x09, RAX, RDX);
+            emit_and_imm(e, RDX, 0x08);
+            emit_shr(e, RDX, 3);
+            emit_shl(e, RDX, mask_shift(FLAG_AUX_CARRY));
+            emit_rr(e, false, 0x21, RAX, REG_A);
+            emit_set_szp(t, REG_A);
+            emit_rr(e, false, 0x09, RDX, REG_F);
+            break;
+
+        case 1:                                     /* XRA */
+            emit_rr(e, false, 0x31, RAX, REG_A);
+            emit_set_szp(t, REG_A);
+            break;
+
+        case 2:                                     /* ORA */
+            emit_rr(e, false, 0x09, RAX, REG_A);
+            emit_set_szp(t, REG_A);
+            break;
+
+        case 3:                                     /* CMP: cy = A < operand, ac = no borrow out of the low nibble */
+            emit_rr(e, false, 0x89, REG_A, RDX);
+            emit_rr(e, false, 0x29, RAX, RDX);
+            emit_rr(e, false, 0x0FB6, RDX, RDX);
+            emit_set_szp(t, RDX);
+            emit_rr(e, false, 0x39, RAX, REG_A);
+            emit_set_flag(e, 0x0F92, FLAG_CARRY);      // setb
+            emit_rr(e, false, 0x89, REG_A, RCX);
+            emit_and_imm(e, RCX, 0x0F);
+            emit_and_imm(e, RAX, 0x0F);
+            emit_rr(e, false, 0x39, RAX, RCX);
+            emit_set_flag(e, 0x0F93, FLAG_AUX_CARRY);      // setae
+            break;
+    }
+}
+
+/* Jcc: flag mask and whether the jump is taken with the flag set, as the interpreter's handlers test them */
+static bool jump_condition(uint8_t opcode, uint8_t *mask, bool *when_set)
+{
+    switch (opcode)
+    {
+        case 0xC2: *mask = FLAG_ZERO;   *when_set = false; return true;    /* JNZ */
+        case 0xCA: *mask = FLAG_ZERO;   *when_set = true;  return true;    /* JZ */
+        case 0xD2: *mask = FLAG_CARRY;  *when_set = false; return true;    /* JNC */
+        case 0xDA: *mask = FLAG_CARRY;  *when_set = true;  return true;    /* JC */
+        case 0xE2: *mask = FLAG_PARITY; *when_set = false; return true;    /* JPO */
+        case 0xEA: *mask = FLAG_PARITY; *when_set = true;  return true;    /* JPE */
+        case 0xF2: *mask = FLAG_SIGN;   *when_set = false; return true;    /* JP */
+        case 0xFA: *mask = FLAG_SIGN;   *when_set = true;  return true;    /* JM */
+    }
+
+    return false;
+}
+
+/* Returns false once the instruction has left the block */
+static bool translate(Translator *t, const MicroOp *op)
+{
+    Emitter *e = &t->e;
+    uint8_t opcode = op->opcode;
+    uint8_t mask;
+    bool when_set;
+
+    if (opcode >= 0x40 && opcode < 0x80 && opcode != 0x76)
+    {
+        /* MOV */
+        int dst = (opcode >> 3) & 7;
+        int src = opcode & 7;
+
+        if (dst == src)
+            return true;
+
+        if (src == GUEST_M)
+        {
+            emit_get_pair(e, 2, RCX);
+            emit_load(t, RAX);
+        }
+        else
+            emit_get_register(e, src);
+
+        if (dst == GUEST_M)
+        {
+            emit_get_pair(e, 2, RSI);
+            emit_rr(e, false, 0x0FB6, RDX, RAX);
+            emit_store(t);
+        }
+        else
+            emit_set_register(e, dst);
+
+        return true;
+    }
+
+    if (opcode >= 0xA0 && opcode < 0xC0)
+    {
+        /* ANA, XRA, ORA, CMP */
+        int src = opcode & 7;
+
+        if (src == GUEST_M)
+        {
+            emit_get_pair(e, 2, RCX);
+            emit_load(t, RAX);
+        }
+        else
+            emit_get_register(e, src);
+
+        emit_logic(t, (opcode >> 3) & 3);
+        return true;
+    }
+
+    if ((opcode & 0xC7) == 0xC6 && opcode >= 0xE6)
+    {
+        /* ANI, XRI, ORI, CPI */
+        emit_mov_imm(e, RAX, (uint8_t)op->operand);
+        emit_logic(t, (opcode >> 3) & 3);
+        return true;
+    }
+
+    if ((opcode & 0xC7) == 0x06)
+    {
+        /* MVI */
+        int dst = (opcode >> 3) & 7;
+
+        if (dst == GUEST_M)
+        {
+            emit_get_pair(e, 2, RSI);
+            emit_mov_imm(e, RDX, (uint8_t)op->operand);
+            emit_store(t);
+        }
+        else
+        {
+            emit_mov_imm(e, RAX, (uint8_t)op->operand);
+            emit_set_register(e, dst);
+        }
+
+        return true;
+    }
+
+    if (jump_condition(opcode, &mask, &when_set))
+    {
+        emit_rr(e, false, 0xF6, 0, REG_F);          // test r14b, mask
+        emit8(e, mask);
+        add_stub(t, emit_jump(e, when_set ? JNZ : JZ), op->operand, 0, 0, true);
+        emit_link(t, t->next);
+        return false;
+    }
+
+    switch (opcode)
+    {
+        case 0x00: case 0x08: case 0x10: case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+            return true;
+
+        case 0x01: case 0x11:                           /* LXI B, LXI D */
+            emit8(e, 0x66);
+            emit_rm(e, false, 0xC7, 0, REG_CPU, PAIR_OFFSET[opcode >> 4]);
+            emit8(e, op->operand & 0xFF);
+            emit8(e, op->operand >> 8);
+            return true;
+
+        case 0x21:                                      /* LXI H */
+            emit_mov_imm(e, REG_HL, op->operand);
+            return true;
+
+        case 0x02: case 0x12:                           /* STAX B, STAX D */
+            emit_get_pair(e, opcode >> 4, RSI);
+            emit_rr(e, false, 0x0FB6, RDX, REG_A);
+            emit_store(t);
+            return true;
+
+        case 0x0A: case 0x1A:                           /* LDAX B, LDAX D */
+            emit_get_pair(e, opcode >> 4, RCX);
+            emit_load(t, REG_A);
+            return true;
+
+        case 0x03: case 0x13:                           /* INX B, INX D */
+        case 0x0B: case 0x1B:                           /* DCX B, DCX D */
+            emit8(e, 0x66);
+            emit_rm(e, false, 0xFF, (opcode & 0x08) ? 1 : 0, REG_CPU, PAIR_OFFSET[opcode >> 4]);
+            return true;
+
+        case 0x23: case 0x2B:                           /* INX H, DCX H */
+            emit_rr(e, false, 0xFF, (opcode & 0x08) ? 1 : 0, REG_HL);
+            emit_and_imm(e, REG_HL, 0xFFFF);
+            return true;
+
+        case 0x2A:                                      /* LHLD */
+            emit_mov_imm(e, RCX, (uint16_t)(op->operand + 1));
+            emit_load(t, REG_HL);
+            emit_shl(e, REG_HL, 8);
+            emit_mov_imm(e, RCX, op->operand);
+            emit_load(t, RAX);
+            emit_rr(e, false, 0x09, RAX, REG_HL);
+            return true;
+
+        case 0x32:                                      /* STA */
+            emit_mov_imm(e, RSI, op->operand);
+            emit_rr(e, false, 0x0FB6, RDX, REG_A);
+            emit_store(t);
+            return true;
+
+        case 0x3A:                                      /* LDA */
+            emit_mov_imm(e, RCX, op->operand);
+            emit_load(t, REG_A);
+            return true;
+
+        case 0x2F:                                      /* CMA */
+            emit_rr(e, false, 0xF6, 2, REG_A);
+            return true;
+
+        case 0x37:                                      /* STC */
+            emit_rr(e, false, 0x80, 1, REG_F);
+            emit8(e, FLAG_CARRY);
+            return true;
+
+        case 0x3F:                                      /* CMC */
+            emit_rr(e, false, 0x80, 6, REG_F);
+            emit8(e, FLAG_CARRY);
+            return true;
+
+        case 0xEB:                                      /* XCHG */
+            emit_get_pair(e, 1, RAX);
+            emit_store_pair(e, 1, REG_HL);
+            emit_rr(e, false, 0x89, RAX, REG_HL);
+            return true;
+
+        case 0xC3:                                      /* JMP */
+            emit_link(t, op->operand);
+            return false;
+
+        case 0xCD:                                      /* CALL */
+            emit_interpret(t, op);
+            emit_rr(e, false, 0x84, RAX, RAX);
+            emit_exit(t, JNZ);
+            emit_link(t, op->operand);
+            return false;
+    }
+
+    emit_interpret(t, op);
+
+    if (ends_block(opcode))
+    {
+        /* The handler has already set registers.pc */
+        emit_exit(t, JMP);
+        return false;
+    }
+
+    emit_check_invalidated(t);
+    return true;
+}
+
+static void emit_entry(Translator *t, const Block *block)
+{
+    Emitter *e = &t->e;
+
+    emit_rm(e, true, 0x8B, RAX, REG_CPU, CPU_FIELD(cycles));
+    emit_rr(e, true, 0x81, 0, RAX);
+    emit32(e, block->taken_cycles);
+    emit_rm(e, true, 0x3B, RAX, REG_RUN, RUN_FIELD(cycle_limit));
+    add_stub(t, emit_jump(e, JAE), block->start, 0, 0, false);
+
+    /* A taken conditional CALL or RET adds its extra cycles itself */
+    if (block->taken_cycles != block->cycles)
+    {
+        emit_rr(e, true, 0x81, 5, RAX);
+        emit32(e, block->taken_cycles - block->cycles);
+    }
+
+    emit_rm(e, true, 0x8B, RCX, REG_RUN, RUN_FIELD(executed));
+    emit_rm(e, true, 0x3B, RCX, REG_RUN, RUN_FIELD(budget));
+    add_stub(t, emit_jump(e, JAE), block->start, 0, 0, false);
+
+    emit_rm(e, true, 0x89, RAX, REG_CPU, CPU_FIELD(cycles));
+    emit_rm(e, true, 0x83, 0, REG_RUN, RUN_FIELD(executed));
+    emit8(e, block->count);
+}
+
+static void emit_stubs(Translator *t)
+{
+    Emitter *e = &t->e;
+
+    for (unsigned i = 0; i < t->stub_count; i++)
+    {
+        const Stub *stub = &t->stubs[i];
+
+        if (!overflowed(e))
+            set_jump(stub->jump, e->code);
+
+        if (stub->cycles)
+        {
+            emit_rm(e, true, 0x81, 5, REG_CPU, CPU_FIELD(cycles));
+            emit32(e, stub->cycles);
+        }
+
+        if (stub->ops)
+        {
+            emit_rm(e, true, 0x83, 5, REG_RUN, RUN_FIELD(executed));
+            emit8(e, stub->ops);
+        }
+
+        if (stub->link)
+            emit_link(t, stub->pc);
+        else
+        {
+            emit_set_pc(e, stub->pc);
+            emit_exit(t, JMP);
+        }
+    }
+}
+
+/* enter(cpu, code, run) and the shared exit, at the start of the arena */
+static void emit_runtime(Jit *jit)
+{
+    static const int saved[] = { RBP, RBX, R12, R13, R14, R15 };
+    Emitter e = { jit->arena, jit->arena + JIT_ARENA_SIZE };
+
+    jit->enter = e.code;
+
+    for (unsigned i = 0; i < sizeof(saved) / sizeof(saved[0]); i++)
+    {
+        emit_rex(&e, false, 0, saved[i]);
+        emit8(&e, 0x50 + (saved[i] & 7));
+    }
+
+    emit_rr(&e, true, 0x83, 5, RSP);                // sub rsp, 8: realign for helper calls
+    emit8(&e, 8);
+    emit_rr(&e, true, 0x89, RDI, REG_CPU);
+    emit_rr(&e, true, 0x89, RDX, REG_RUN);
+    emit_rm(&e, true, 0x8D, REG_MEMORY, REG_CPU, CPU_FIELD(memory_map.read));   // lea
+    emit_reload(&e);
+    emit_rr(&e, false, 0xFF, 4, RSI);               // jmp rsi
+
+    jit->exit = e.code;
+
+    emit_spill(&e);
+    emit_rr(&e, true, 0x83, 0, RSP);
+    emit8(&e, 8);
+
+    for (int i = sizeof(saved) / sizeof(saved[0]) - 1; i >= 0; i--)
+    {
+        emit_rex(&e, false, 0, saved[i]);
+        emit8(&e, 0x58 + (saved[i] & 7));
+    }
+
+    emit8(&e, 0xC3);
+
+    jit->runtime_size = e.code - jit->arena;
+}
+
+/* Make the arena writable to emit or patch code, or executable again */
+static void set_writable(Jit *jit, bool writable)
+{
+    if (mprotect(jit->arena, JIT_ARENA_SIZE, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) != 0) {
+        perror("Error protecting JIT arena");
+        exit(EXIT_FAILURE);
+    }
+}
+
+Jit* jit_create(JitStepFn step, JitStoreFn store, JitLoadFn load)
+{
+    Jit *jit = (Jit*)calloc(1, sizeof(Jit));
+
+    if (!jit) {
+        fprintf(stderr, "Error allocating JIT: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    void *arena = mmap(NULL, JIT_ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (arena == MAP_FAILED) {
+        perror("Error mapping JIT arena");
+        free(jit);
+        return NULL;
+    }
+
+    jit->arena = (uint8_t*)arena;
+    jit->step = step;
+    jit->store = store;
+    jit->load = load;
+
+    emit_runtime(jit);
+    set_writable(jit, false);
+    jit_flush(jit);
+
+    return jit;
+}
+
+void jit_free(Jit *jit)
+{
+    if (!jit)
+        return;
+
+    munmap(jit->arena, JIT_ARENA_SIZE);
+    free(jit);
+}
+
+static void track(Jit *jit, const JitEntry *slot, int delta)
+{
+    uint8_t first = slot->pc >> BLOCK_PAGE_SHIFT;
+    uint8_t last = (uint16_t)(slot->pc + slot->size - 1) >> BLOCK_PAGE_SHIFT;
+
+    jit->code_pages[first] += delta;
+
+    if (last != first)
+        jit->code_pages[last] += delta;
+
+    for (uint16_t offset = 0; offset < slot->size; offset++)
+        jit->code_bytes[(uint16_t)(slot->pc + offset)] += delta;
+}
+
+/* Drop a translation: exits chained into it go back to exit, its own exits are forgotten */
+static void evict(Jit *jit, JitEntry *slot)
+{
+    for (unsigned i = 0; i < jit->link_count; )
+    {
+        JitLink *link = &jit->links[i];
+
+        if (link->patch >= slot->code && link->patch < slot->end)
+        {
+            *link = jit->links[--jit->link_count];
+            continue;
+        }
+
+        if (link->target == slot->pc)
+            set_jump(link->patch, jit->exit);
+
+        i++;
+    }
+
+    track(jit, slot, -1);
+    slot->code = NULL;
+}
+
+const void* jit_compile(Jit *jit, const Block *block)
+{
+    Translator t = { .jit = jit };
+    bool open = true;
+
+    t.e = (Emitter){ jit->arena + jit->used, jit->arena + JIT_ARENA_SIZE };
+    t.address = block->start;
+    t.cycles = block->cycles;
+    t.ops = block->count;
+
+    uint8_t *entry = t.e.code;
+
+    set_writable(jit, true);
+    emit_entry(&t, block);
+
+    for (unsigned i = 0; i < block->count && open; i++)
+    {
+        const MicroOp *op = &block->ops[i];
+
+        t.next = t.address + INSTRUCTION_LENGTH[op->opcode];
+        t.cycles -= INSTRUCTION_CYCLES[op->opcode];
+        t.ops--;
+
+        open = translate(&t, op);
+        t.address = t.next;
+    }
+
+    if (open)
+        emit_link(&t, t.address);
+
+    emit_stubs(&t);
+
+    if (overflowed(&t.e))
+    {
+        set_writable(jit, false);
+        jit_flush(jit);
+        return NULL;
+    }
+
+    jit->used = t.e.code - jit->arena;
+
+    JitEntry *slot = &jit->table[block->start & (JIT_TABLE_SIZE - 1)];
+
+    // another PC on the same slot
+    if (slot->code)
+        evict(jit, slot);
+
+    *slot = (JitEntry){ entry, t.e.code, block->start, block->size };
+    track(jit, slot, +1);
+
+    /* Chain the exits that were waiting for this block, its own loops included */
+    for (unsigned i = 0; i < jit->link_count; i++)
+    {
+        if (jit->links[i].target == block->start)
+            set_jump(jit->links[i].patch, entry);
+    }
+
+    /* and this block's exits to what is translated already; untracked ones keep going to exit */
+    for (unsigned i = 0; i < t.link_count && jit->link_count < JIT_MAX_LINKS; i++)
+    {
+        const uint8_t *target = jit_lookup(jit, t.links[i].target);
+
+        if (target)
+            set_jump(t.links[i].patch, target);
+
+        jit->links[jit->link_count++] = t.links[i];
+    }
+
+    set_writable(jit, false);
+
+    return entry;
+}
+
+void jit_invalidate(Jit *jit, uint16_t address)
+{
+    bool writable = false;
+
+    // a translation covering address starts at most BLOCK_MAX_SIZE - 1 bytes before it
+    for (uint16_t back = 0; back < BLOCK_MAX_SIZE && jit->code_bytes[address]; back++)
+    {
+        uint16_t pc = address - back;
+        JitEntry *slot = &jit->table[pc & (JIT_TABLE_SIZE - 1)];
+
+        if (slot->code && slot->pc == pc && back < slot->size)
+        {
+            if (!writable)
+                set_writable(jit, writable = true);
+
+            evict(jit, slot);
+        }
+    }
+
+    if (writable)
+        set_writable(jit, false);
+
+    jit->invalidated = true;
+}
+
+uint64_t jit_run(Jit *jit, Cpu8080 *cpu, const void *entry, uint64_t cycle_limit, uint64_t budget)
+{
+    JitRun run = { cycle_limit, budget, 0 };
+    void (*enter)(Cpu8080 *, const void *, JitRun *);
+
+    memcpy(&enter, &jit->enter, sizeof(enter));
+    enter(cpu, entry, &run);
+
+    return run.executed;
+}
+
+#else
+
+Jit* jit_create(JitStepFn step, JitStoreFn store, JitLoadFn load)
+{
+    (void)step;
+    (void)store;
+    (void)load;
+    return NULL;
+}
+
+void jit_free(Jit *jit)
+{
+    (void)jit;
+}
+
+const void* jit_compile(Jit *jit, const Block *block)
+{
+    (void)jit;
+    (void)block;
+    return NULL;
+}
+
+void jit_invalidate(Jit *jit, uint16_t address)
+{
+    (void)jit;
+    (void)address;
+}
+
+uint64_t jit_run(Jit *jit, Cpu8080 *cpu, const void *entry, uint64_t cycle_limit, uint64_t budget)
+{
+    (void)jit;
+    (void)cpu;
+    (void)entry;
+    (void)cycle_limit;
+    (void)budget;
+    return 0;
+}
+
+#endif
+
+void jit_flush(Jit *jit)
+{
+    jit->used = jit->runtime_size;
+    jit->link_count = 0;
+    jit->invalidated = false;
+
+    memset(jit->table, 0, sizeof(jit->table));
+    memset(jit->code_pages, 0, sizeof(jit->code_pages));
+    memset(jit->code_bytes, 0, sizeof(jit->code_bytes));
+}
+
+const void* jit_lookup(Jit *jit, uint16_t pc)
+{
+    const JitEntry *slot = &jit->table[pc & (JIT_TABLE_SIZE - 1)];
+
+    if (slot->code == NULL || slot->pc != pc)
+        return NULL;
+
+    return slot->code;
+}
@@ -1,18 +1,88 @@
-#include <stdio.h>
+#ifdef HEADLESS
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#else
 #include <SDL2/SDL.h>
+#endif
+
+#include <stdio.h>
 
 #include <main.h>
 #include <cpu.h>
+
+#ifdef HEADLESS
+
+static void usage(const char *program)
+{
+    fprintf(stderr, "usage: %s [-c cycles | -f frames]\n", program);
+    exit(EXIT_FAILURE);
+}
+
+static uint64_t parse_count(const char *text, const char *program)
+{
+    char *end;
+    unsigned long long value = strtoull(text, &end, 0);
+
+    if (*text == '\0' || *end != '\0' || value == 0)
+        usage(program);
+
+    return value;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t cycle_limit = HEADLESS_DEFAULT_FRAMES * (uint64_t)CYCLES_PER_FRAME;
+
+    for (int arg = 1; arg < argc; arg++)
+    {
+        if (strcmp(argv[arg], "-c") == 0 && arg + 1 < argc)
+            cycle_limit = parse_count(argv[++arg], argv[0]);
+        else if (strcmp(argv[arg], "-f") == 0 && arg + 1 < argc)
+            cycle_limit = parse_count(argv[++arg], argv[0]) * CYCLES_PER_FRAME;
+        else
+            usage(argv[0]);
+    }
+
+    Cpu8080 *cpu = init_cpu();
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    RunResult result = intel8080_headless(cpu, cycle_limit);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("%llu instructions, %llu cycles in %.3f s: %.2f MHz (%.1fx real time), %.1f MIPS\n",
+           (unsigned long long)result.instructions, (unsigned long long)result.cycles, seconds,
+           result.cycles / seconds / 1e6, result.cycles / seconds / CYCLES_PER_SECOND,
+           result.instructions / seconds / 1e6);
+
+    if (result.reason == STOP_UNIMPLEMENTED)
+        printf("stopped at unimplemented opcode, pc=%04X\n", cpu->registers.pc);
+
+    free_cpu(cpu);
+
+    return result.reason == STOP_UNIMPLEMENTED ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#else
+
 #include <screen.h>
 
 int main()
 {
-    init_screen();
+    Screen *screen = init_screen();
     Cpu8080 *cpu =  init_cpu();
 
-    intel8080_main(cpu);
+    intel8080_main(cpu, screen);
     
-    finish_and_free(cpu);
+    free_cpu(cpu);
+    free_screen(screen);
+    SDL_Quit();
 
     return 0;
 }
+
+#endif
@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <memory_map.h>
+#include <cpu.h>
+#include <bus.h>
+
+/* Value read from an MMIO page without a read handler */
+#define OPEN_BUS 0xFF
+
+static void check_range(uint16_t start, uint16_t end)
+{
+    if ((start & MEMORY_PAGE_MASK) != 0 || (end & MEMORY_PAGE_MASK) != MEMORY_PAGE_MASK || end < start)
+    {
+        fprintf(stderr, "Memory range 0x%04X-0x%04X does not cover whole pages\n", start, end);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void map_pages(MemoryMap *map, uint16_t start, uint16_t end, PageType type)
+{
+    check_range(start, end);
+
+    for (unsigned page = start >> MEMORY_PAGE_SHIFT; page <= (unsigned)(end >> MEMORY_PAGE_SHIFT); page++)
+    {
+        memory_map_unshare(map, page);
+
+        uint8_t *bytes = map->memory + (page << MEMORY_PAGE_SHIFT);
+
+        map->read[page] = bytes;
+        map->write[page] = (type == PAGE_RAM) ? bytes : NULL;
+        map->mmio_read[page] = NULL;
+        map->mmio_write[page] = NULL;
+        map->type[page] = type;
+    }
+}
+
+void memory_map_init(MemoryMap *map, uint8_t *memory)
+{
+    map->memory = memory;
+    memset(map->shared, 0, sizeof(map->shared));
+    map_ram(map, 0x0000, 0xFFFF);
+}
+
+void map_ram(MemoryMap *map, uint16_t start, uint16_t end)
+{
+    map_pages(map, start, end, PAGE_RAM);
+}
+
+void map_rom(MemoryMap *map, uint16_t start, uint16_t end)
+{
+    map_pages(map, start, end, PAGE_ROM);
+}
+
+/* Repeat the pages of source_start-source_end over start-end */
+void map_mirror(MemoryMap *map, uint16_t start, uint16_t end, uint16_t source_start, uint16_t source_end)
+{
+    check_range(start, end);
+    check_range(source_start, source_end);
+
+    unsigned source_first = source_start >> MEMORY_PAGE_SHIFT;
+    unsigned source_count = (source_end >> MEMORY_PAGE_SHIFT) - source_first + 1;
+    unsigned first = start >> MEMORY_PAGE_SHIFT;
+
+    for (unsigned page = first; page <= (unsigned)(end >> MEMORY_PAGE_SHIFT); page++)
+    {
+        unsigned source = source_first + (page - first) % source_count;
+
+        if (map->type[source] == PAGE_MIRROR)
+        {
+            fprintf(stderr, "Cannot mirror page 0x%04X, it is a mirror itself\n", source << MEMORY_PAGE_SHIFT);
+            exit(EXIT_FAILURE);
+        }
+
+        map->read[page] = map->read[source];
+        map->write[page] = map->write[source];
+        map->mmio_read[page] = map->mmio_read[source];
+        map->mmio_write[page] = map->mmio_write[source];
+        map->shared[page] = map->shared[source];
+        map->type[page] = (map->type[source] == PAGE_MMIO) ? PAGE_MMIO : PAGE_MIRROR;
+    }
+}
+
+void map_mmio(MemoryMap *map, uint16_t start, uint16_t end, MmioRead read, MmioWrite write)
+{
+    check_range(start, end);
+
+    for (unsigned page = start >> MEMORY_PAGE_SHIFT; page <= (unsigned)(end >> MEMORY_PAGE_SHIFT); page++)
+    {
+        memory_map_unshare(map, page);
+
+        map->read[page] = NULL;
+        map->write[page] = NULL;
+        map->mmio_read[page] = read;
+        map->mmio_write[page] = write;
+        map->shared[page] = NULL;
+        map->type[page] = PAGE_MMIO;
+    }
+}
+
+void map_shared_rom(MemoryMap *map, uint16_t address, SharedPage *shared)
+{
+    map_pages(map, address, address | MEMORY_PAGE_MASK, PAGE_ROM);
+
+    unsigned page = address >> MEMORY_PAGE_SHIFT;
+
+    shared->users++;
+    map->read[page] = shared->bytes;
+    map->shared[page] = shared;
+}
+
+SharedPage* shared_page_create(const uint8_t *bytes)
+{
+    SharedPage *shared = (SharedPage*)malloc(sizeof(SharedPage));
+
+    if (!shared) {
+        fprintf(stderr, "Error allocating shared page: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(shared->bytes, bytes, MEMORY_PAGE_SIZE);
+    atomic_init(&shared->users, 1);
+
+    return shared;
+}
+
+void shared_page_release(SharedPage *shared)
+{
+    if (--shared->users == 0)
+        free(shared);
+}
+
+/* The RAM or ROM page whose bytes shared holds, seen at page directly or through a mirror */
+static unsigned shared_owner(const MemoryMap *map, unsigned page)
+{
+    for (unsigned owner = 0; owner < MEMORY_PAGE_COUNT; owner++)
+    {
+        if (map->shared[owner] == map->shared[page] && page_is_direct(map, owner << MEMORY_PAGE_SHIFT))
+            return owner;
+    }
+
+    return page;
+}
+
+/* Move a RAM or ROM page of its own into a SharedPage, the page and its mirrors reading from there */
+static SharedPage* share_page(MemoryMap *map, unsigned page)
+{
+    if (map->shared[page])
+        return map->shared[page];
+
+    uint8_t *bytes = map->memory + (page << MEMORY_PAGE_SHIFT);
+    SharedPage *shared = shared_page_create(bytes);
+
+    for (unsigned other = 0; other < MEMORY_PAGE_COUNT; other++)
+    {
+        if (map->read[other] != bytes)
+            continue;
+
+        map->read[other] = shared->bytes;
+        map->write[other] = NULL;
+        map->shared[other] = shared;
+    }
+
+    return shared;
+}
+
+void memory_map_share(MemoryMap *parent, MemoryMap *child, uint8_t *child_memory)
+{
+    for (unsigned page = 0; page < MEMORY_PAGE_COUNT; page++)
+    {
+        if (page_is_direct(parent, page << MEMORY_PAGE_SHIFT))
+            share_page(parent, page)->users++;
+    }
+
+    memcpy(child->read, parent->read, sizeof(child->read));
+    memcpy(child->write, parent->write, sizeof(child->write));
+    memcpy(child->mmio_read, parent->mmio_read, sizeof(child->mmio_read));
+    memcpy(child->mmio_write, parent->mmio_write, sizeof(child->mmio_write));
+    memcpy(child->type, parent->type, sizeof(child->type));
+    memcpy(child->shared, parent->shared, sizeof(child->shared));
+    child->memory = child_memory;
+}
+
+void memory_map_unshare(MemoryMap *map, unsigned page)
+{
+    SharedPage *shared = map->shared[page];
+
+    if (!shared || !page_is_direct(map, page << MEMORY_PAGE_SHIFT))
+        return;
+
+    uint8_t *bytes = map->memory + (page << MEMORY_PAGE_SHIFT);
+
+    memcpy(bytes, shared->bytes, MEMORY_PAGE_SIZE);
+
+    for (unsigned other = 0; other < MEMORY_PAGE_COUNT; other++)
+    {
+        if (map->shared[other] != shared)
+            continue;
+
+        map->read[other] = bytes;
+        map->write[other] = (map->type[page] == PAGE_RAM) ? bytes : NULL;
+        map->shared[other] = NULL;
+    }
+
+    shared_page_release(shared);
+}
+
+void memory_map_release(MemoryMap *map)
+{
+    for (unsigned page = 0; page < MEMORY_PAGE_COUNT; page++)
+    {
+        if (map->shared[page] && page_is_direct(map, page << MEMORY_PAGE_SHIFT))
+            shared_page_release(map->shared[page]);
+    }
+
+    memset(map->shared, 0, sizeof(map->shared));
+}
+
+uint8_t memory_map_read(Cpu8080 *cpu, uint16_t address)
+{
+    MmioRead read = cpu->memory_map.mmio_read[address >> MEMORY_PAGE_SHIFT];
+
+    return read ? read(cpu, address) : OPEN_BUS;
+}
+
+void memory_map_write(Cpu8080 *cpu, uint16_t address, uint8_t value)
+{
+    unsigned page = address >> MEMORY_PAGE_SHIFT;
+
+    // first store to a shared RAM page: take a copy and store there
+    if (cpu->memory_map.shared[page])
+    {
+        unsigned owner = shared_owner(&cpu->memory_map, page);
+
+        if (cpu->memory_map.type[owner] == PAGE_RAM)
+        {
+            memory_map_unshare(&cpu->memory_map, owner);
+            write_memory(cpu, address, value);
+            return;
+        }
+    }
+
+    MmioWrite write = cpu->memory_map.mmio_write[address >> MEMORY_PAGE_SHIFT];
+
+    // ROM pages have no handler, the store is dropped
+    if (write)
+        write(cpu, address, value);
+}
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <pool.h>
+
+static Cpu8080* create_machine()
+{
+    Cpu8080 *cpu = init_cpu();
+
+    load_machine(cpu);
+
+    return cpu;
+}
+
+MachinePool* pool_create(unsigned capacity, uint64_t boot_cycles)
+{
+    if (capacity == 0)
+    {
+        fprintf(stderr, "Machine pool needs at least one machine\n");
+        exit(EXIT_FAILURE);
+    }
+
+    MachinePool *pool = (MachinePool*)aligned_alloc(_Alignof(MachinePool), sizeof(MachinePool));
+
+    if (!pool) {
+        fprintf(stderr, "Error allocating machine pool: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    pool->machines = (Cpu8080**)malloc(capacity * sizeof(Cpu8080*));
+    pool->handed_out = (bool*)calloc(capacity, sizeof(bool));
+    pool->idle = (Cpu8080**)malloc(capacity * sizeof(Cpu8080*));
+
+    if (!pool->machines || !pool->handed_out || !pool->idle) {
+        fprintf(stderr, "Error allocating machine pool: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    pool->capacity = capacity;
+    pthread_mutex_init(&pool->lock, NULL);
+
+    Cpu8080 *boot = create_machine();
+
+    while (boot->cycles < boot_cycles)
+    {
+        RunResult result = run_cycles(boot, boot_cycles - boot->cycles);
+
+        if (result.reason == STOP_UNIMPLEMENTED || result.reason == STOP_HALT)
+            break;
+    }
+
+    save_state(boot, &pool->template);
+
+    pool->machines[0] = boot;
+
+    for (unsigned index = 1; index < capacity; index++)
+        pool->machines[index] = create_machine();
+
+    memcpy(pool->idle, pool->machines, capacity * sizeof(Cpu8080*));
+
+    pool->idle_count = capacity;
+
+    return pool;
+}
+
+void pool_free(MachinePool *pool)
+{
+    if (!pool)
+        return;
+
+    if (pool->idle_count != pool->capacity)
+        fprintf(stderr, "Machine pool freed with %u machines still handed out\n", pool->capacity - pool->idle_count);
+
+    for (unsigned index = 0; index < pool->idle_count; index++)
+        free_cpu(pool->idle[index]);
+
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->machines);
+    free(pool->handed_out);
+    free(pool->idle);
+    free(pool);
+}
+
+/* Index of cpu in pool->machines, capacity when it is not one of them */
+static unsigned machine_index(const MachinePool *pool, const Cpu8080 *cpu)
+{
+    unsigned index = 0;
+
+    while (index < pool->capacity && pool->machines[index] != cpu)
+        index++;
+
+    return index;
+}
+
+Cpu8080* pool_acquire(MachinePool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+
+    Cpu8080 *cpu = pool->idle_count ? pool->idle[--pool->idle_count] : NULL;
+
+    if (cpu)
+        pool->handed_out[machine_index(pool, cpu)] = true;
+
+    pthread_mutex_unlock(&pool->lock);
+
+    if (cpu)
+        pool_reset(pool, cpu);
+
+    return cpu;
+}
+
+void pool_release(MachinePool *pool, Cpu8080 *cpu)
+{
+    pthread_mutex_lock(&pool->lock);
+
+    unsigned index = machine_index(pool, cpu);
+
+    if (index == pool->capacity)
+    {
+        fprintf(stderr, "Machine released to a pool it was not taken from\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (!pool->handed_out[index])
+    {
+        fprintf(stderr, "Machine released to its pool twice\n");
+        exit(EXIT_FAILURE);
+    }
+
+    pool->handed_out[index] = false;
+    pool->idle[pool->idle_count++] = cpu;
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_reset(const MachinePool *pool, Cpu8080 *cpu)
+{
+    // the machines share one schedule and ROM, a template always loads
+    if (!load_state(cpu, &pool->template))
+    {
+        fprintf(stderr, "Machine pool template does not load\n");
+        exit(EXIT_FAILURE);
+    }
+}
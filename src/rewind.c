@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <rewind.h>
+
+#define STATE_HEADER_SIZE offsetof(MachineState, memory)
+
+RewindBuffer* rewind_create(unsigned capacity, unsigned frames_per_snapshot, unsigned keyframe_interval, size_t page_capacity)
+{
+    if (capacity == 0 || frames_per_snapshot == 0 || keyframe_interval == 0 || page_capacity < 2 * MEMORY_PAGE_COUNT)
+    {
+        fprintf(stderr, "Rewind buffer needs snapshots, a frame and keyframe interval and at least %d pages\n",
+                2 * MEMORY_PAGE_COUNT);
+        exit(EXIT_FAILURE);
+    }
+
+    RewindBuffer *buffer = (RewindBuffer*)aligned_alloc(_Alignof(RewindBuffer), sizeof(RewindBuffer));
+
+    if (!buffer) {
+        fprintf(stderr, "Error allocating rewind buffer: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    memset(buffer, 0, sizeof(RewindBuffer));
+
+    buffer->snapshots = (RewindSnapshot*)calloc(capacity, sizeof(RewindSnapshot));
+    buffer->pages = (uint8_t (*)[MEMORY_PAGE_SIZE])malloc(page_capacity * MEMORY_PAGE_SIZE);
+    buffer->page_numbers = (uint8_t*)malloc(page_capacity);
+
+    if (!buffer->snapshots || !buffer->pages || !buffer->page_numbers) {
+        fprintf(stderr, "Error allocating rewind history: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    buffer->capacity = capacity;
+    buffer->frames_per_snapshot = frames_per_snapshot;
+    buffer->keyframe_interval = keyframe_interval;
+    buffer->page_capacity = page_capacity;
+
+    return buffer;
+}
+
+void rewind_free(RewindBuffer *buffer)
+{
+    if (!buffer)
+        return;
+
+    free(buffer->snapshots);
+    free(buffer->pages);
+    free(buffer->page_numbers);
+    free(buffer);
+}
+
+/* The index-th snapshot, oldest first */
+static inline RewindSnapshot* snapshot_at(RewindBuffer *buffer, unsigned index)
+{
+    return &buffer->snapshots[(buffer->first + index) % buffer->capacity];
+}
+
+/* Drop the oldest snapshot and the deltas that depend on it */
+static void drop_oldest(RewindBuffer *buffer)
+{
+    do
+    {
+        buffer->first = (buffer->first + 1) % buffer->capacity;
+        buffer->count--;
+    } while (buffer->count && !snapshot_at(buffer, 0)->keyframe);
+
+    buffer->page_tail = buffer->count ? snapshot_at(buffer, 0)->first_page : buffer->page_head;
+}
+
+static void make_room(RewindBuffer *buffer, unsigned pages)
+{
+    while (buffer->count && (buffer->count == buffer->capacity ||
+                             buffer->page_head + pages - buffer->page_tail > buffer->page_capacity))
+        drop_oldest(buffer);
+}
+
+static void take_snapshot(RewindBuffer *buffer, const Cpu8080 *cpu)
+{
+    uint8_t changed[MEMORY_PAGE_COUNT];
+    unsigned changed_count = 0;
+    bool keyframe = buffer->count == 0 || buffer->since_keyframe + 1 >= buffer->keyframe_interval;
+
+    save_state(cpu, &buffer->state);
+
+    if (!keyframe)
+    {
+        for (unsigned page = 0; page < MEMORY_PAGE_COUNT; page++)
+        {
+            unsigned offset = page << MEMORY_PAGE_SHIFT;
+
+            if (memcmp(buffer->state.memory + offset, buffer->reference + offset, MEMORY_PAGE_SIZE) != 0)
+                changed[changed_count++] = page;
+        }
+
+        make_room(buffer, changed_count);
+
+        // the keyframe it would have been a delta of is gone
+        keyframe = buffer->count == 0;
+    }
+
+    if (keyframe)
+    {
+        for (unsigned page = 0; page < MEMORY_PAGE_COUNT; page++)
+            changed[page] = page;
+
+        changed_count = MEMORY_PAGE_COUNT;
+        make_room(buffer, changed_count);
+    }
+
+    RewindSnapshot *snapshot = snapshot_at(buffer, buffer->count++);
+
+    memcpy(snapshot->header, &buffer->state, STATE_HEADER_SIZE);
+    snapshot->first_page = buffer->page_head;
+    snapshot->page_count = changed_count;
+    snapshot->keyframe = keyframe;
+
+    for (unsigned i = 0; i < changed_count; i++)
+    {
+        size_t slot = buffer->page_head++ % buffer->page_capacity;
+        unsigned offset = changed[i] << MEMORY_PAGE_SHIFT;
+
+        memcpy(buffer->pages[slot], buffer->state.memory + offset, MEMORY_PAGE_SIZE);
+        buffer->page_numbers[slot] = changed[i];
+    }
+
+    if (buffer->count == 1)
+        buffer->page_tail = snapshot->first_page;
+
+    memcpy(buffer->reference, buffer->state.memory, TOTAL_MEMORY_SIZE);
+    buffer->since_keyframe = keyframe ? 0 : buffer->since_keyframe + 1;
+}
+
+void rewind_record_frame(RewindBuffer *buffer, const Cpu8080 *cpu)
+{
+    if (++buffer->frame < buffer->frames_per_snapshot)
+        return;
+
+    buffer->frame = 0;
+    take_snapshot(buffer, cpu);
+}
+
+bool rewind_step_back(RewindBuffer *buffer, Cpu8080 *cpu, unsigned steps)
+{
+    if (steps >= buffer->count)
+        return false;
+
+    unsigned target = buffer->count - 1 - steps;
+    unsigned keyframe = target;
+
+    // the oldest snapshot is always a keyframe
+    while (!snapshot_at(buffer, keyframe)->keyframe)
+        keyframe--;
+
+    // the keyframe, then each delta on top of it
+    for (unsigned index = keyframe; index <= target; index++)
+    {
+        const RewindSnapshot *snapshot = snapshot_at(buffer, index);
+
+        for (unsigned i = 0; i < snapshot->page_count; i++)
+        {
+            size_t slot = (snapshot->first_page + i) % buffer->page_capacity;
+
+            memcpy(buffer->state.memory + (buffer->page_numbers[slot] << MEMORY_PAGE_SHIFT),
+                   buffer->pages[slot], MEMORY_PAGE_SIZE);
+        }
+    }
+
+    const RewindSnapshot *snapshot = snapshot_at(buffer, target);
+
+    memcpy(&buffer->state, snapshot->header, STATE_HEADER_SIZE);
+
+    if (!load_state(cpu, &buffer->state))
+        return false;
+
+    buffer->count = target + 1;
+    buffer->page_head = snapshot->first_page + snapshot->page_count;
+    buffer->since_keyframe = target - keyframe;
+    buffer->frame = 0;
+    memcpy(buffer->reference, buffer->state.memory, TOTAL_MEMORY_SIZE);
+
+    return true;
+}
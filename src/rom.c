@@ -1,5 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 
 #include <rom.h>
 #include <debug.h>
@@ -78,3 +80,88 @@ int get_rom_size()
     fclose(fp);
     return bufsize;
 }
+
+_Static_assert((ROM_LOAD_ADDRESS & MEMORY_PAGE_MASK) == 0, "ROM_LOAD_ADDRESS must start a page");
+
+/* The store: one image, shared by every machine that loaded it */
+static pthread_mutex_t rom_lock = PTHREAD_MUTEX_INITIALIZER;
+static RomImage *rom_image;
+
+static RomImage* load_image()
+{
+    char *rom = get_rom();
+
+    if (rom == NULL)
+        return NULL;
+
+    unsigned size = get_rom_size();
+
+    if (size > 0x10000 - ROM_LOAD_ADDRESS)
+    {
+        fprintf(stderr, "ROM of %u bytes does not fit at 0x%04X\n", size, ROM_LOAD_ADDRESS);
+        free(rom);
+        exit(EXIT_FAILURE);
+    }
+
+    RomImage *image = (RomImage*)calloc(1, sizeof(RomImage));
+
+    if (image == NULL) {
+        perror("Memory allocation error");
+        free(rom);
+        return NULL;
+    }
+
+    image->size = size;
+    image->page_count = (size + MEMORY_PAGE_MASK) >> MEMORY_PAGE_SHIFT;
+
+    for (unsigned index = 0; index < image->page_count; index++)
+    {
+        uint8_t bytes[MEMORY_PAGE_SIZE] = { 0 };
+        unsigned offset = index << MEMORY_PAGE_SHIFT;
+        unsigned length = (size - offset < MEMORY_PAGE_SIZE) ? size - offset : MEMORY_PAGE_SIZE;
+
+        memcpy(bytes, rom + offset, length);
+        image->pages[index] = shared_page_create(bytes);
+    }
+
+    free(rom);
+
+    return image;
+}
+
+const RomImage* acquire_rom()
+{
+    pthread_mutex_lock(&rom_lock);
+
+    if (rom_image == NULL)
+        rom_image = load_image();
+
+    if (rom_image)
+        rom_image->users++;
+
+    const RomImage *image = rom_image;
+
+    pthread_mutex_unlock(&rom_lock);
+
+    return image;
+}
+
+void release_rom(const RomImage *image)
+{
+    if (image == NULL)
+        return;
+
+    pthread_mutex_lock(&rom_lock);
+
+    // machines still mapping a page keep it alive through its own count
+    if (--rom_image->users == 0)
+    {
+        for (unsigned index = 0; index < rom_image->page_count; index++)
+            shared_page_release(rom_image->pages[index]);
+
+        free(rom_image);
+        rom_image = NULL;
+    }
+
+    pthread_mutex_unlock(&rom_lock);
+}
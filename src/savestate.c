@@ -0,0 +1,143 @@
+#include <string.h>
+
+#include <savestate.h>
+#include <block_cache.h>
+#include <jit.h>
+
+void save_state(const Cpu8080 *cpu, MachineState *state)
+{
+    const Registers *registers = &cpu->registers;
+
+    // padding included, so equal machines give equal bytes
+    memset(state, 0, offsetof(MachineState, memory));
+
+    state->magic = MACHINE_STATE_MAGIC;
+    state->version = MACHINE_STATE_VERSION;
+
+    state->cycles = cpu->cycles;
+
+    for (int id = 0; id < EVENT_COUNT; id++)
+    {
+        const Event *event = &cpu->scheduler.events[id];
+
+        state->event_deadline[id] = event->handler ? event->deadline : UINT64_MAX;
+        state->event_period[id] = event->handler ? event->period : 0;
+    }
+
+    state->pc = registers->pc;
+    state->sp = registers->sp;
+    state->B = registers->B;
+    state->C = registers->C;
+    state->D = registers->D;
+    state->E = registers->E;
+    state->H = registers->H;
+    state->L = registers->L;
+    state->A = registers->A;
+    state->F = registers->F;
+    state->lazy = registers->lazy;
+    state->interrupt_enabled = cpu->interrupt_enabled;
+    state->halted = cpu->halted;
+    memcpy(state->io_data, cpu->io_data, sizeof(state->io_data));
+
+    // pages shared with a clone hold their bytes elsewhere, mirrors and MMIO none
+    for (unsigned page = 0; page < MEMORY_PAGE_COUNT; page++)
+    {
+        uint16_t address = page << MEMORY_PAGE_SHIFT;
+
+        if (page_is_direct(&cpu->memory_map, address))
+            memcpy(state->memory + address, cpu->memory_map.read[page], MEMORY_PAGE_SIZE);
+        else
+            memset(state->memory + address, 0, MEMORY_PAGE_SIZE);
+    }
+}
+
+/* Drop decoded and translated code on the pages the loaded memory changes */
+static void invalidate_changed_code(Cpu8080 *cpu, const uint8_t *memory)
+{
+    for (unsigned page = 0; page < BLOCK_PAGE_COUNT; page++)
+    {
+        bool cached = cpu->block_cache && cpu->block_cache->code_pages[page];
+        bool translated = cpu->jit && cpu->jit->code_pages[page];
+        unsigned offset = page << BLOCK_PAGE_SHIFT;
+
+        if (!cached && !translated)
+            continue;
+
+        const uint8_t *bytes = cpu->memory_map.read[page];
+
+        if (bytes && memcmp(bytes, memory + offset, 1 << BLOCK_PAGE_SHIFT) == 0)
+            continue;
+
+        if (cached)
+            block_cache_invalidate_page(cpu->block_cache, page);
+
+        // nothing translated is running, drop it now rather than at the next store
+        if (translated)
+            jit_flush(cpu->jit);
+    }
+}
+
+bool load_state(Cpu8080 *cpu, const MachineState *state)
+{
+    EventHandler handlers[EVENT_COUNT];
+
+    if (state->magic != MACHINE_STATE_MAGIC || state->version != MACHINE_STATE_VERSION)
+        return false;
+
+    // handlers are code, they come from cpu's own schedule
+    for (int id = 0; id < EVENT_COUNT; id++)
+    {
+        handlers[id] = cpu->scheduler.events[id].handler;
+
+        if (state->event_deadline[id] != UINT64_MAX && handlers[id] == NULL)
+            return false;
+    }
+
+    // RAM becomes the machine's own again, shared ROM pages stay with their image
+    for (unsigned page = 0; page < MEMORY_PAGE_COUNT; page++)
+    {
+        if (cpu->memory_map.type[page] == PAGE_RAM)
+            memory_map_unshare(&cpu->memory_map, page);
+    }
+
+    invalidate_changed_code(cpu, state->memory);
+
+    for (unsigned page = 0; page < MEMORY_PAGE_COUNT; page++)
+    {
+        uint16_t address = page << MEMORY_PAGE_SHIFT;
+
+        if (page_is_direct(&cpu->memory_map, address) && !cpu->memory_map.shared[page])
+            memcpy(cpu->memory + address, state->memory + address, MEMORY_PAGE_SIZE);
+    }
+
+    Registers *registers = &cpu->registers;
+
+    registers->pc = state->pc;
+    registers->sp = state->sp;
+    registers->B = state->B;
+    registers->C = state->C;
+    registers->D = state->D;
+    registers->E = state->E;
+    registers->H = state->H;
+    registers->L = state->L;
+    registers->A = state->A;
+    registers->F = state->F;
+    registers->lazy = state->lazy;
+    cpu->interrupt_enabled = state->interrupt_enabled;
+    cpu->halted = state->halted;
+    memcpy(cpu->io_data, state->io_data, sizeof(cpu->io_data));
+
+    // an unimplemented opcode stopped the machine's old run, not the state's
+    cpu->error_occurred = -1;
+
+    cpu->cycles = state->cycles;
+    scheduler_init(&cpu->scheduler);
+
+    for (int id = 0; id < EVENT_COUNT; id++)
+    {
+        if (state->event_deadline[id] != UINT64_MAX)
+            scheduler_add(&cpu->scheduler, id, state->event_deadline[id], state->event_period[id], handlers[id]);
+    }
+
+    return true;
+}
@@ -0,0 +1,61 @@
+#include <scheduler.h>
+
+static void update_next(Scheduler *scheduler)
+{
+    scheduler->next = UINT64_MAX;
+
+    for (int id = 0; id < EVENT_COUNT; id++)
+    {
+        const Event *event = &scheduler->events[id];
+
+        if (event->handler && event->deadline < scheduler->next)
+            scheduler->next = event->deadline;
+    }
+}
+
+void scheduler_init(Scheduler *scheduler)
+{
+    for (int id = 0; id < EVENT_COUNT; id++)
+        scheduler->events[id] = (Event){ 0, 0, NULL };
+
+    scheduler->next = UINT64_MAX;
+}
+
+void scheduler_add(Scheduler *scheduler, EventId id, uint64_t deadline, uint64_t period, EventHandler handler)
+{
+    scheduler->events[id] = (Event){ deadline, period, handler };
+    update_next(scheduler);
+}
+
+void scheduler_cancel(Scheduler *scheduler, EventId id)
+{
+    scheduler->events[id].handler = NULL;
+    update_next(scheduler);
+}
+
+void scheduler_run(Scheduler *scheduler, struct Cpu8080 *cpu, uint64_t now)
+{
+    while (scheduler->next <= now)
+    {
+        Event *due = NULL;
+
+        for (int id = 0; id < EVENT_COUNT; id++)
+        {
+            Event *event = &scheduler->events[id];
+
+            if (event->handler && (due == NULL || event->deadline < due->deadline))
+                due = event;
+        }
+
+        EventHandler handler = due->handler;
+
+        /* Re-arm before calling, the handler may reschedule */
+        if (due->period)
+            due->deadline += due->period;
+        else
+            due->handler = NULL;
+
+        update_next(scheduler);
+        handler(cpu);
+    }
+}
@@ -1,29 +1,25 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <string.h>
 #include <SDL2/SDL.h>
 
 #include <main.h>
 #include <helper.h>
 #include <cpu.h>
+#include <screen.h>
 
 #define SCREEN_PROPORTION 2
 
-SDL_Window *window;
-SDL_Renderer *renderer;
-SDL_Texture *texture;
-SDL_PixelFormat *format;
-Uint32 screen_buffer[VIDEO_RAM_SIZE * 8];
-
-void create_window()
+void create_window(Screen *screen)
 {
-    window = SDL_CreateWindow(
+    screen->window = SDL_CreateWindow(
         "Intel 8080",
         SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
         HEIGHT * SCREEN_PROPORTION, WIDTH * SCREEN_PROPORTION,
         SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
 
-    if (!window)
+    if (!screen->window)
     {
         fprintf(stderr, "Failed to create window: %s\n", SDL_GetError());
         SDL_Quit();
@@ -31,43 +27,43 @@ void create_window()
     }
 }
 
-void create_render()
+void create_render(Screen *screen)
 {
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    screen->renderer = SDL_CreateRenderer(screen->window, -1, SDL_RENDERER_ACCELERATED);
 
-    if (!renderer)
+    if (!screen->renderer)
     {
         fprintf(stderr, "Failed to create renderer: %s\n", SDL_GetError());
-        SDL_DestroyWindow(window);
+        SDL_DestroyWindow(screen->window);
         SDL_Quit();
         exit(1);
     }
 }
 
-void create_texture()
+void create_texture(Screen *screen)
 {
-    texture = SDL_CreateTexture(
-        renderer,
+    screen->texture = SDL_CreateTexture(
+        screen->renderer,
         SDL_PIXELFORMAT_RGBA8888,
         SDL_TEXTUREACCESS_STREAMING,
         WIDTH,
         HEIGHT);
 
-    if (!texture)
+    if (!screen->texture)
     {
         fprintf(stderr, "Failed to create texture: %s\n", SDL_GetError());
-        SDL_DestroyRenderer(renderer);
-        SDL_DestroyWindow(window);
+        SDL_DestroyRenderer(screen->renderer);
+        SDL_DestroyWindow(screen->window);
         SDL_Quit();
         exit(1);
     }
 }
 
-void init_sdl_screen_buffer()
+void init_sdl_screen_buffer(Screen *screen)
 {
     for (unsigned index = 0; index < (WIDTH * HEIGHT); index++)
     {
-        screen_buffer[index] = SDL_MapRGBA(format, 255, 0, 0, 255); // Red for debugging
+        screen->buffer[index] = SDL_MapRGBA(screen->format, 255, 0, 0, 255); // Red for debugging
     }
 }
 
@@ -98,77 +94,88 @@ inline static SDL_Rect calculate_dest_rect(SDL_Window *window, int texture_width
     return (SDL_Rect){centerX, centerY, dest_width, dest_height};
 }
 
-void update_screen()
+void update_screen(Screen *screen)
 {
-    if (texture == NULL) return;
+    if (screen == NULL) return;
     
-    SDL_UpdateTexture(texture, NULL, screen_buffer, WIDTH * sizeof(Uint32));
-    SDL_RenderClear(renderer);
+    SDL_UpdateTexture(screen->texture, NULL, screen->buffer, WIDTH * sizeof(Uint32));
+    SDL_RenderClear(screen->renderer);
 
-    SDL_Rect dest_rect = calculate_dest_rect(window, WIDTH, HEIGHT);
+    SDL_Rect dest_rect = calculate_dest_rect(screen->window, WIDTH, HEIGHT);
 
     /* Draw with a 90-degree rotation */
-    SDL_RenderCopyEx(renderer, texture, NULL, &dest_rect, 90, NULL, SDL_FLIP_NONE);
+    SDL_RenderCopyEx(screen->renderer, screen->texture, NULL, &dest_rect, 90, NULL, SDL_FLIP_NONE);
 
-    SDL_RenderPresent(renderer);
+    SDL_RenderPresent(screen->renderer);
 }
 
-void finish_and_free(Cpu8080 *cpu)
+void free_screen(Screen *screen)
 {
-    if (format)
-        SDL_FreeFormat(format);
+    if (!screen)
+        return;
 
-    SDL_DestroyTexture(texture);
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
-    SDL_Quit();
+    if (screen->format)
+        SDL_FreeFormat(screen->format);
 
-    if (cpu)
-    {
-        free(cpu->rom);
-        free(cpu->memory);
-    }
+    SDL_DestroyTexture(screen->texture);
+    SDL_DestroyRenderer(screen->renderer);
+    SDL_DestroyWindow(screen->window);
+    SDL_QuitSubSystem(SDL_INIT_VIDEO);
+
+    free(screen);
 }
 
-void buffer_to_screen(Cpu8080 *cpu)
+void buffer_to_screen(Screen *screen, Cpu8080 *cpu)
 {
-    if (texture == NULL) return;
-
-    uint8_t *buffer = (cpu->memory + VIDEO_RAM_START);
+    if (screen == NULL) return;
 
     for (unsigned byte = 0; byte < VIDEO_RAM_SIZE; byte++)
     {
+        // through the map, a cloned machine's pages may be shared
+        uint8_t value = direct_byte(&cpu->memory_map, VIDEO_RAM_START + byte);
+
         for (unsigned bit = 0; bit < 8; bit++)
         {
-            uint8_t bit_choosed = (buffer[byte] >> (7 - bit)) & 1;
+            uint8_t bit_choosed = (value >> (7 - bit)) & 1;
 
             unsigned index = ((VIDEO_RAM_SIZE - 1 - byte) * 8 + bit);
 
             Uint8 color = bit_choosed ? 255 : 0; /* White or Black*/
 
-            screen_buffer[index] = SDL_MapRGBA(format, color, color, color, 255);
+            screen->buffer[index] = SDL_MapRGBA(screen->format, color, color, color, 255);
         }
     }
 }
 
-void init_screen()
+Screen* init_screen()
 {
-    if (SDL_Init(SDL_INIT_VIDEO) < 0)
+    Screen *screen = (Screen*)calloc(1, sizeof(Screen));
+
+    if (!screen)
+    {
+        fprintf(stderr, "Error allocating screen: %s\n", strerror(errno));
+        exit(1);
+    }
+
+    /* Reference counted by SDL, so each screen can init and quit video on its own */
+    if (SDL_InitSubSystem(SDL_INIT_VIDEO) < 0)
     {
         fprintf(stderr, "Failed to initialize SDL: %s\n", SDL_GetError());
         exit(1);
     }
 
-    format = SDL_AllocFormat(SDL_PIXELFORMAT_RGBA8888);
-    if (!format)
+    screen->format = SDL_AllocFormat(SDL_PIXELFORMAT_RGBA8888);
+    if (!screen->format)
     {
         fprintf(stderr, "Failed to allocate pixel format: %s\n", SDL_GetError());
         exit(1);
     }
 
-    create_window();
-    create_render();
-    create_texture();
-    init_sdl_screen_buffer();
-    update_screen();
-}
\ No newline at end of file
+    create_window(screen);
+    create_render(screen);
+    create_texture(screen);
+    init_sdl_screen_buffer(screen);
+    update_screen(screen);
+
+    return screen;
+}
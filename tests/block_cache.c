@@ -0,0 +1,57 @@
+#include <test.h>
+#include <bus.h>
+
+/*
+ * Stores only evict the cached blocks covering the byte they write: data
+ * next to code on the same page leaves the code cached.
+ */
+
+static const uint8_t program[] = {
+    0x3E, 0x01,             // 0100 MVI A,1
+    0x06, 0x02,             // 0102 inner: MVI B,2
+    0x80,                   // 0104 ADD B
+    0xC3, 0x02, 0x01,       // 0105 JMP inner
+    0x00, 0x00              // 0108 data
+};
+
+int main()
+{
+    Cpu8080 *cpu = test_machine(program, sizeof(program), ENGINE_BLOCK_CACHE);
+    BlockCache *cache = cpu->block_cache;
+
+    Block *outer = block_cache_decode(cache, &cpu->memory_map, 0x0100, NULL);
+    Block *inner = block_cache_decode(cache, &cpu->memory_map, 0x0102, NULL);
+
+    CHECK(outer && outer->size == 8);
+    CHECK(inner && inner->size == 6);
+    CHECK(cache->code_bytes[0x0101] == 1);
+    CHECK(cache->code_bytes[0x0103] == 2);
+    CHECK(cache->code_bytes[0x0108] == 0);
+
+    // data on the code's page
+    write_memory(cpu, 0x0108, 0x55);
+    write_memory(cpu, 0x01FF, 0x55);
+    CHECK(block_cache_lookup(cache, 0x0100) == outer);
+    CHECK(block_cache_lookup(cache, 0x0102) == inner);
+
+    // the first block only
+    write_memory(cpu, 0x0101, 0x03);
+    CHECK(block_cache_lookup(cache, 0x0100) == NULL);
+    CHECK(block_cache_lookup(cache, 0x0102) == inner);
+    CHECK(cache->code_bytes[0x0101] == 0);
+    CHECK(cache->code_bytes[0x0103] == 1);
+
+    // both, when they overlap
+    outer = block_cache_decode(cache, &cpu->memory_map, 0x0100, NULL);
+    write_memory(cpu, 0x0103, 0x04);
+    CHECK(block_cache_lookup(cache, 0x0100) == NULL);
+    CHECK(block_cache_lookup(cache, 0x0102) == NULL);
+    CHECK(cache->code_pages[0x01] == 0);
+
+    for (unsigned address = 0x0100; address < 0x0110; address++)
+        CHECK(cache->code_bytes[address] == 0);
+
+    free_cpu(cpu);
+
+    return test_result();
+}
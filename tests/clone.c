@@ -0,0 +1,171 @@
+#include <test.h>
+#include <bus.h>
+#include <savestate.h>
+
+/*
+ * Copy on write between a machine and its clones. A clone taken mid-run
+ * carries on exactly as its parent does, though it runs interpreted and
+ * the parent translated. Each side's stores, direct or through a mirror,
+ * stay its own; stores to ROM copy nothing. A clone takes its parent's
+ * breakpoints as a copy of its own. Freeing either side first gives up
+ * its users of the SharedPages. The test holds a user of its own on the
+ * pages it looks at, so they are still there to count once every machine
+ * is gone.
+ */
+
+#define RAM_PAGE    0x20        // filled by the program
+#define MIRRORED    0x21        // stored to through its mirror
+#define UNTOUCHED   0x22
+#define ROM_PAGE    0x30
+#define MIRROR      0x41        // mirror of MIRRORED
+#define HALT        0x0112
+
+static const uint8_t program[] = {
+    0x21, 0x00, 0x20,       // 0100 LXI H,2000h
+    0x34,                   // 0103 loop: INR M
+    0x23,                   // 0104 INX H
+    0x7C,                   // 0105 MOV A,H
+    0xFE, 0x21,             // 0106 CPI 21h
+    0xC2, 0x03, 0x01,       // 0108 JNZ loop
+    0x3A, 0x00, 0x30,       // 010B LDA 3000h
+    0x32, 0x10, 0x41,       // 010E STA 4110h
+    0xF5,                   // 0111 PUSH PSW
+    0x76                    // 0112 HLT
+};
+
+static SharedPage* hold(SharedPage *shared)
+{
+    shared->users++;
+
+    return shared;
+}
+
+static void drop(SharedPage *shared)
+{
+    if (--shared->users == 0)
+        free(shared);
+}
+
+static unsigned users(const SharedPage *shared)
+{
+    return shared->users;
+}
+
+/* Whether a and b saved the same state, flags aside: translated code leaves them resolved, the interpreter pending */
+static bool same_state(const Cpu8080 *a, const Cpu8080 *b)
+{
+    static MachineState state_a, state_b;
+
+    save_state(a, &state_a);
+    save_state(b, &state_b);
+
+    state_a.F = state_b.F = 0;
+    memset(&state_a.lazy, 0, sizeof(LazyFlags));
+    memset(&state_b.lazy, 0, sizeof(LazyFlags));
+
+    return memcmp(&state_a, &state_b, sizeof(MachineState)) == 0;
+}
+
+static Cpu8080* parent_machine()
+{
+    Cpu8080 *cpu = test_machine(program, sizeof(program), ENGINE_JIT);
+
+    cpu->memory[ROM_PAGE << 8] = 0x5A;
+    map_rom(&cpu->memory_map, ROM_PAGE << 8, (ROM_PAGE << 8) | 0xFF);
+    map_mirror(&cpu->memory_map, MIRROR << 8, (MIRROR << 8) | 0xFF, MIRRORED << 8, (MIRRORED << 8) | 0xFF);
+
+    return cpu;
+}
+
+static void diverge(bool parent_first)
+{
+    Cpu8080 *parent = parent_machine();
+
+    test_context = parent_first ? "parent freed first" : "clone freed first";
+
+    // mid-fill
+    CHECK(run_cycles(parent, 4000).reason == STOP_BUDGET);
+
+    Cpu8080 *child = clone_cpu(parent);
+
+    CHECK(!child->block_cache && !child->jit);
+    CHECK(same_state(parent, child));
+
+    SharedPage *ram = hold(parent->memory_map.shared[RAM_PAGE]);
+    SharedPage *mirrored = hold(parent->memory_map.shared[MIRRORED]);
+    SharedPage *untouched = hold(parent->memory_map.shared[UNTOUCHED]);
+    SharedPage *rom = hold(parent->memory_map.shared[ROM_PAGE]);
+
+    CHECK(child->memory_map.shared[RAM_PAGE] == ram);
+    CHECK(parent->memory_map.shared[MIRROR] == mirrored && child->memory_map.shared[MIRROR] == mirrored);
+    CHECK(users(ram) == 3 && users(mirrored) == 3 && users(untouched) == 3 && users(rom) == 3);
+
+    // both finish the fill, store through the mirror and push the same flags, each to pages of its own
+    CHECK(run_cycles(parent, 1000000).reason == STOP_HALT);
+    CHECK(run_cycles(child, 1000000).reason == STOP_HALT);
+    CHECK(child->registers.pc == HALT + 1);
+    CHECK(same_state(parent, child));
+
+    CHECK(!parent->memory_map.shared[RAM_PAGE] && !child->memory_map.shared[RAM_PAGE]);
+    CHECK(!child->memory_map.shared[MIRRORED] && !child->memory_map.shared[MIRROR]);
+    CHECK(users(ram) == 1 && users(mirrored) == 1);
+    CHECK(read_memory(child, (MIRRORED << 8) | 0x10) == 0x5A);
+
+    write_memory(child, (RAM_PAGE << 8) | 0x10, 0xCC);
+    write_memory(parent, (MIRROR << 8) | 0x10, 0xAA);
+
+    CHECK(read_memory(child, (RAM_PAGE << 8) | 0x10) == 0xCC);
+    CHECK(read_memory(parent, (RAM_PAGE << 8) | 0x10) == 0x01);
+    CHECK(read_memory(parent, (MIRRORED << 8) | 0x10) == 0xAA);
+    CHECK(read_memory(child, (MIRROR << 8) | 0x10) == 0x5A);
+
+    // a store to ROM is dropped without taking a copy
+    write_memory(child, ROM_PAGE << 8, 0xFF);
+
+    CHECK(read_memory(child, ROM_PAGE << 8) == 0x5A);
+    CHECK(child->memory_map.shared[ROM_PAGE] == rom);
+    CHECK(users(rom) == 3);
+
+    // a clone of the clone shares the same pages and copies its breakpoints
+    set_breakpoint(child, HALT);
+
+    Cpu8080 *grandchild = clone_cpu(child);
+
+    CHECK(grandchild->memory_map.shared[ROM_PAGE] == rom);
+    CHECK(users(rom) == 4 && users(untouched) == 4);
+    CHECK(grandchild->breakpoint_count == 1 && grandchild->breakpoints[HALT]);
+
+    clear_breakpoint(grandchild, HALT);
+
+    CHECK(child->breakpoint_count == 1 && child->breakpoints[HALT]);
+
+    free_cpu(grandchild);
+
+    CHECK(users(rom) == 3 && users(untouched) == 3);
+
+    Cpu8080 *first = parent_first ? parent : child;
+    Cpu8080 *second = parent_first ? child : parent;
+
+    free_cpu(first);
+
+    CHECK(users(rom) == 2 && users(untouched) == 2);
+    CHECK(read_memory(second, ROM_PAGE << 8) == 0x5A);
+    CHECK(read_memory(second, (MIRRORED << 8) | 0x10) == (parent_first ? 0x5A : 0xAA));
+
+    free_cpu(second);
+
+    CHECK(users(ram) == 1 && users(mirrored) == 1 && users(untouched) == 1 && users(rom) == 1);
+
+    drop(ram);
+    drop(mirrored);
+    drop(untouched);
+    drop(rom);
+}
+
+int main()
+{
+    diverge(true);
+    diverge(false);
+
+    return test_result();
+}
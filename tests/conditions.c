@@ -0,0 +1,55 @@
+#include <test.h>
+
+/*
+ * JP, CP and RP are taken on S clear, whatever the parity, on every
+ * engine. A loop counts the values of B - 20h each of them sees as
+ * positive or negative, long enough for the JIT to translate the JP.
+ */
+
+#define PASSES 0x40
+#define POSITIVE (PASSES - 0x20 + 1)    // B - 20h for B = 40h down to 20h
+#define NEGATIVE (PASSES - POSITIVE)
+
+static const uint8_t program[] = {
+    0x06, PASSES,           // 0100 MVI B,PASSES
+    0x16, 0x00,             // 0102 MVI D,0
+    0x1E, 0x00,             // 0104 MVI E,0
+    0x0E, 0x00,             // 0106 MVI C,0
+    0x78,                   // 0108 loop: MOV A,B
+    0xD6, 0x20,             // 0109 SUI 20h
+    0xF2, 0x0F, 0x01,       // 010B JP over
+    0x14,                   // 010E INR D
+    0xB7,                   // 010F over: ORA A
+    0xF4, 0x20, 0x01,       // 0110 CP count_e
+    0xB7,                   // 0113 ORA A
+    0xCD, 0x24, 0x01,       // 0114 CALL count_c
+    0x05,                   // 0117 DCR B
+    0xC2, 0x08, 0x01,       // 0118 JNZ loop
+    0x76,                   // 011B HLT
+    0, 0, 0, 0,
+    0x1C,                   // 0120 count_e: INR E
+    0xC9,                   // 0121 RET
+    0, 0,
+    0xF0,                   // 0124 count_c: RP
+    0x0C,                   // 0125 INR C
+    0xC9                    // 0126 RET
+};
+
+int main()
+{
+    for (Engine engine = 0; engine < ENGINE_COUNT; engine++)
+    {
+        Cpu8080 *cpu = test_machine(program, sizeof(program), engine);
+        RunResult result = run_cycles(cpu, 1000000);
+
+        CHECK(result.reason == STOP_HALT);
+        CHECK(cpu->registers.D == NEGATIVE);
+        CHECK(cpu->registers.E == POSITIVE);
+        CHECK(cpu->registers.C == NEGATIVE);
+        CHECK(!cpu->jit || jit_lookup(cpu->jit, 0x0108));
+
+        free_cpu(cpu);
+    }
+
+    return test_result();
+}
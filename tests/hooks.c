@@ -0,0 +1,151 @@
+#include <test.h>
+
+/*
+ * Native hooks, on every engine. A loop calls a routine until the block
+ * engines have it cached and translated, then the routine is hooked: the
+ * translated CALL must not jump past the hook. A hook replaces the routine
+ * with its own cycles plus the RET, a second one at the same address
+ * replaces the first, one that halts ends the run on the routine, and
+ * clear_hook() gives the routine back. A breakpoint on the return address
+ * stops every engine at the same place and cycle.
+ */
+
+#define PASSES 200
+#define ROUTINE 0x0200
+#define RESULT 0x0300
+#define HOOK_CYCLES 50
+
+// MVI B and HLT; one pass is CALL, the routine or hook and its RET, DCR B, JNZ
+#define CYCLES(opcode) ((unsigned)INSTRUCTION_CYCLES[opcode])
+#define OUTSIDE_CYCLES (CYCLES(0x06) + CYCLES(0x76))
+#define HOOKED_PASS_CYCLES (CYCLES(0xCD) + HOOK_CYCLES + CYCLES(0xC9) + CYCLES(0x05) + CYCLES(0xC2))
+#define ROUTINE_PASS_CYCLES (CYCLES(0xCD) + CYCLES(0x3E) + CYCLES(0x32) + CYCLES(0xC9) + CYCLES(0x05) + CYCLES(0xC2))
+
+static const uint8_t program[] = {
+    0x06, PASSES,           // 0100 MVI B,PASSES
+    0xCD, 0x00, 0x02,       // 0102 loop: CALL routine
+    0x05,                   // 0105 DCR B
+    0xC2, 0x02, 0x01,       // 0106 JNZ loop
+    0x76                    // 0109 HLT
+};
+
+static const uint8_t routine[] = {
+    0x3E, 0x99,             // 0200 routine: MVI A,99h
+    0x32, RESULT & 0xFF, RESULT >> 8,   // 0202 STA RESULT
+    0xC9                    // 0205 RET
+};
+
+static uint32_t count_call(Cpu8080 *cpu, void *context)
+{
+    (*(unsigned*)context)++;
+    cpu->registers.A = 0x42;
+
+    return HOOK_CYCLES;
+}
+
+static uint32_t end_program(Cpu8080 *cpu, void *context)
+{
+    (void)context;
+    cpu->halted = true;
+
+    return 0;
+}
+
+static void restart(Cpu8080 *cpu)
+{
+    cpu->registers.pc = TEST_PROGRAM_START;
+    cpu->registers.sp = 0xF000;
+    cpu->halted = false;
+    cpu->memory[RESULT] = 0;
+}
+
+int main()
+{
+    for (Engine engine = 0; engine < ENGINE_COUNT; engine++)
+    {
+        Cpu8080 *cpu = test_machine(program, sizeof(program), engine);
+
+        memcpy(cpu->memory + ROUTINE, routine, sizeof(routine));
+
+        RunResult result = run_cycles(cpu, 1000000);
+
+        CHECK(result.reason == STOP_HALT);
+        CHECK(result.cycles == OUTSIDE_CYCLES + PASSES * ROUTINE_PASS_CYCLES);
+        CHECK(cpu->memory[RESULT] == 0x99);
+        CHECK(!cpu->jit || jit_lookup(cpu->jit, TEST_PROGRAM_START + 2));
+
+        // hooked after the CALL was translated
+        unsigned calls = 0;
+
+        restart(cpu);
+        set_hook(cpu, ROUTINE, count_call, &calls);
+        result = run_cycles(cpu, 1000000);
+
+        CHECK(result.reason == STOP_HALT);
+        CHECK(cpu->registers.pc == 0x010A);
+        CHECK(cpu->registers.sp == 0xF000);
+        CHECK(result.cycles == OUTSIDE_CYCLES + PASSES * HOOKED_PASS_CYCLES);
+        CHECK(result.instructions == 2 + PASSES * 4);
+        CHECK(calls == PASSES);
+        CHECK(cpu->registers.A == 0x42);
+        CHECK(cpu->memory[RESULT] == 0);
+        CHECK(!cpu->jit || !jit_lookup(cpu->jit, ROUTINE));
+
+        // a breakpoint on the return address stops after the hook's RET, and again a pass later
+        restart(cpu);
+        calls = 0;
+        set_breakpoint(cpu, 0x0105);
+        result = run_cycles(cpu, 1000000);
+
+        CHECK(result.reason == STOP_BREAKPOINT);
+        CHECK(cpu->registers.pc == 0x0105);
+        CHECK(result.cycles == CYCLES(0x06) + CYCLES(0xCD) + HOOK_CYCLES + CYCLES(0xC9));
+        CHECK(result.instructions == 3);
+        CHECK(calls == 1);
+
+        result = run_cycles(cpu, 1000000);
+
+        CHECK(result.reason == STOP_BREAKPOINT);
+        CHECK(cpu->registers.pc == 0x0105);
+        CHECK(result.cycles == HOOKED_PASS_CYCLES);
+        CHECK(result.instructions == 4);
+        CHECK(calls == 2);
+
+        clear_breakpoint(cpu, 0x0105);
+
+        // a second hook at the address replaces the first
+        unsigned replaced = 0;
+
+        set_hook(cpu, ROUTINE, count_call, &replaced);
+        result = run_cycles(cpu, 1000000);
+
+        CHECK(result.reason == STOP_HALT);
+        CHECK(result.cycles == CYCLES(0x05) + CYCLES(0xC2) + (PASSES - 2) * HOOKED_PASS_CYCLES + CYCLES(0x76));
+        CHECK(calls == 2);
+        CHECK(replaced == PASSES - 2);
+        CHECK(cpu->hook_count == 1);
+
+        // a hook that does not return halts on the routine, its return address still pushed
+        restart(cpu);
+        set_hook(cpu, ROUTINE, end_program, NULL);
+        result = run_cycles(cpu, 1000000);
+
+        CHECK(result.reason == STOP_HALT);
+        CHECK(cpu->registers.pc == ROUTINE);
+        CHECK(cpu->registers.sp == 0xF000 - 2);
+
+        // without a hook the routine runs again
+        restart(cpu);
+        clear_hook(cpu, ROUTINE);
+        result = run_cycles(cpu, 1000000);
+
+        CHECK(result.reason == STOP_HALT);
+        CHECK(result.cycles == OUTSIDE_CYCLES + PASSES * ROUTINE_PASS_CYCLES);
+        CHECK(cpu->hook_count == 0);
+        CHECK(cpu->memory[RESULT] == 0x99);
+
+        free_cpu(cpu);
+    }
+
+    return test_result();
+}
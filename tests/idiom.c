@@ -0,0 +1,53 @@
+#include <test.h>
+
+/*
+ * The fill-to-H idiom (MVI M,d8 / INX H / MOV A,H / CPI d8 / JNZ) against
+ * the loop it replaces: the video events stay scheduled so the block
+ * engines cut the fill into runs between them, as in a real program.
+ */
+
+#define FILL_BYTE 0xA5
+
+static void fill_to_h(uint16_t start, uint8_t limit, uint16_t end)
+{
+    const uint8_t program[] = {
+        0x21, start & 0xFF, start >> 8,     // LXI H,start
+        0xC3, 0x06, 0x01,                   // JMP loop, so the loop is a block of its own from the start
+        0x36, FILL_BYTE,                    // loop: MVI M,FILL_BYTE
+        0x23,                               // INX H
+        0x7C,                               // MOV A,H
+        0xFE, limit,                        // CPI limit
+        0xC2, 0x06, 0x01,                   // JNZ loop
+        0x76                                // HLT
+    };
+
+    for (Engine engine = 0; engine < ENGINE_COUNT; engine++)
+    {
+        Cpu8080 *cpu = test_machine(program, sizeof(program), engine);
+        RunResult result = run_cycles(cpu, 1000000);
+
+        CHECK(result.reason == STOP_HALT);
+        CHECK(cpu->registers.HL == end);
+        CHECK(cpu->registers.A == limit);
+        CHECK(memcmp(cpu->memory + TEST_PROGRAM_START, program, sizeof(program)) == 0);
+        CHECK(cpu->memory[start - 1] == 0);
+        CHECK(cpu->memory[end] == 0);
+
+        for (uint16_t address = start; address != end; address++)
+            CHECK(cpu->memory[address] == FILL_BYTE);
+
+        free_cpu(cpu);
+    }
+}
+
+int main()
+{
+    // H already at the limit: one pass
+    fill_to_h(0x2405, 0x24, 0x2406);
+
+    // from below: up to the limit page
+    fill_to_h(0x2300, 0x24, 0x2400);
+    fill_to_h(0x20F0, 0x24, 0x2400);
+
+    return test_result();
+}
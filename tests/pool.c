@@ -0,0 +1,109 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <test.h>
+#include <bus.h>
+#include <pool.h>
+
+/*
+ * Machines handed out by a pool start from its template, however far the
+ * last run took them or wherever it stopped, and only machines the pool
+ * handed out, once each, go back to it. Runs the Invaders ROM from rom/,
+ * as `make check` does from the top of the tree.
+ */
+
+#define BOOT_CYCLES 2000000
+
+static MachineState state;
+
+static bool is_template(const MachinePool *pool, const Cpu8080 *cpu)
+{
+    save_state(cpu, &state);
+
+    return memcmp(&state, &pool->template, sizeof(MachineState)) == 0;
+}
+
+/* Whether pool_release() of cpu exits with a failure, tried in a child process */
+static bool release_fails(MachinePool *pool, Cpu8080 *cpu)
+{
+    fflush(stderr);
+
+    pid_t child = fork();
+
+    if (child == 0)
+    {
+        // the error is expected, keep it out of the output
+        if (!freopen("/dev/null", "w", stderr))
+            _exit(EXIT_SUCCESS);
+
+        pool_release(pool, cpu);
+        _exit(EXIT_SUCCESS);
+    }
+
+    int status;
+
+    return child > 0 && waitpid(child, &status, 0) == child &&
+           WIFEXITED(status) && WEXITSTATUS(status) == EXIT_FAILURE;
+}
+
+int main()
+{
+    test_context = "Invaders";
+
+    MachinePool *pool = pool_create(2, BOOT_CYCLES);
+
+    CHECK(pool->template.cycles >= BOOT_CYCLES);
+
+    Cpu8080 *first = pool_acquire(pool);
+    Cpu8080 *second = pool_acquire(pool);
+
+    CHECK(first && second && first != second);
+    CHECK(!pool_acquire(pool));
+    CHECK(is_template(pool, first) && is_template(pool, second));
+
+    // the game runs on, then comes back as the template
+    run_cycles(first, 10 * CYCLES_PER_FRAME);
+    CHECK(!is_template(pool, first));
+
+    pool_release(pool, first);
+    CHECK(release_fails(pool, first));
+
+    Cpu8080 *again = pool_acquire(pool);
+
+    CHECK(again == first);
+    CHECK(is_template(pool, again));
+
+    // and so does a run put back with pool_reset(), keeping the ROM code it decoded
+    run_cycles(again, 10 * CYCLES_PER_FRAME);
+    pool_reset(pool, again);
+
+    CHECK(is_template(pool, again));
+    CHECK(!again->block_cache || block_cache_lookup(again->block_cache, pool->template.pc));
+
+    // a machine stopped by an undefined opcode runs the game again after pool_reset()
+    write_memory(again, VIDEO_RAM_START, 0xCB);
+    again->registers.pc = VIDEO_RAM_START;
+    CHECK(run_cycles(again, CYCLES_PER_FRAME).reason == STOP_UNIMPLEMENTED);
+
+    pool_reset(pool, again);
+
+    RunResult result = run_cycles(again, 10 * CYCLES_PER_FRAME);
+
+    CHECK(result.reason == STOP_BUDGET);
+    CHECK(result.cycles >= 10 * CYCLES_PER_FRAME);
+
+    Cpu8080 *foreign = init_cpu();
+
+    CHECK(release_fails(pool, foreign));
+    free_cpu(foreign);
+
+    pool_release(pool, again);
+    pool_release(pool, second);
+    CHECK(pool->idle_count == pool->capacity);
+
+    pool_free(pool);
+
+    return test_result();
+}
@@ -0,0 +1,138 @@
+#include <test.h>
+#include <rewind.h>
+
+/*
+ * The rewind history of a loop that bumps bytes over a few pages a frame.
+ * Keyframes hold every page and deltas only the changed ones; going back
+ * to a keyframe, to a delta on top of one and past the newest keyframe
+ * must each give the state save_state() had at that frame, byte for byte,
+ * and recording on from there must start the next keyframe on time. When
+ * either ring is full the oldest snapshots go, back to a keyframe.
+ */
+
+#define FRAMES 24
+#define FRAMES_PER_SNAPSHOT 2
+#define KEYFRAME_INTERVAL 3
+#define SNAPSHOTS (FRAMES / FRAMES_PER_SNAPSHOT)
+
+static const uint8_t program[] = {
+    0x21, 0x00, 0x20,       // 0100 LXI H,2000h
+    0x34,                   // 0103 loop: INR M
+    0x23,                   // 0104 INX H
+    0x7C,                   // 0105 MOV A,H
+    0xE6, 0x3F,             // 0106 ANI 3Fh
+    0xF6, 0x20,             // 0108 ORI 20h
+    0x67,                   // 010A MOV H,A
+    0xC3, 0x03, 0x01        // 010B JMP loop
+};
+
+// the state at each snapshot of the first recording, as save_state() has it
+static MachineState expected[SNAPSHOTS];
+static MachineState state;
+
+static bool state_is(const Cpu8080 *cpu, unsigned snapshot)
+{
+    save_state(cpu, &state);
+
+    return memcmp(&state, &expected[snapshot], sizeof(MachineState)) == 0;
+}
+
+/* The index-th snapshot of buffer, oldest first */
+static const RewindSnapshot* snapshot_at(const RewindBuffer *buffer, unsigned index)
+{
+    return &buffer->snapshots[(buffer->first + index) % buffer->capacity];
+}
+
+static void record(RewindBuffer *buffer, Cpu8080 *cpu, unsigned snapshots)
+{
+    for (unsigned frame = 0; frame < snapshots * FRAMES_PER_SNAPSHOT; frame++)
+    {
+        run_cycles(cpu, CYCLES_PER_FRAME);
+        rewind_record_frame(buffer, cpu);
+    }
+}
+
+int main()
+{
+    Cpu8080 *cpu = test_machine(program, sizeof(program), ENGINE_JIT);
+
+    // room for 8 snapshots; the second buffer has room for all of them but pages for just two keyframes
+    RewindBuffer *buffer = rewind_create(8, FRAMES_PER_SNAPSHOT, KEYFRAME_INTERVAL, 4 * MEMORY_PAGE_COUNT);
+    RewindBuffer *few_pages = rewind_create(SNAPSHOTS, FRAMES_PER_SNAPSHOT, KEYFRAME_INTERVAL, 2 * MEMORY_PAGE_COUNT);
+
+    for (unsigned snapshot = 0; snapshot < SNAPSHOTS; snapshot++)
+    {
+        for (unsigned frame = 0; frame < FRAMES_PER_SNAPSHOT; frame++)
+        {
+            run_cycles(cpu, CYCLES_PER_FRAME);
+            rewind_record_frame(buffer, cpu);
+            rewind_record_frame(few_pages, cpu);
+        }
+
+        save_state(cpu, &expected[snapshot]);
+    }
+
+    // snapshots 0 to 11 with keyframes at 0, 3, 6 and 9; 0 to 5 were dropped for room
+    CHECK(buffer->count == 6);
+
+    for (unsigned index = 0; index < buffer->count; index++)
+    {
+        const RewindSnapshot *snapshot = snapshot_at(buffer, index);
+
+        CHECK(snapshot->keyframe == (index % KEYFRAME_INTERVAL == 0));
+
+        if (snapshot->keyframe)
+            CHECK(snapshot->page_count == MEMORY_PAGE_COUNT);
+        else
+            CHECK(snapshot->page_count > 0 && snapshot->page_count < MEMORY_PAGE_COUNT / 8);
+    }
+
+    // deeper than the history: nothing changes
+    CHECK(!rewind_step_back(buffer, cpu, buffer->count));
+    CHECK(buffer->count == 6);
+    CHECK(state_is(cpu, SNAPSHOTS - 1));
+
+    // to the newest keyframe, then on by a delta
+    CHECK(rewind_step_back(buffer, cpu, 2));
+    CHECK(state_is(cpu, 9));
+    CHECK(buffer->count == 4);
+
+    record(buffer, cpu, 1);
+    CHECK(state_is(cpu, 10));
+    CHECK(!snapshot_at(buffer, 4)->keyframe);
+    CHECK(rewind_step_back(buffer, cpu, 0));
+    CHECK(state_is(cpu, 10));
+
+    // past the newest keyframe to the last delta of the one before: that keyframe is forgotten
+    CHECK(rewind_step_back(buffer, cpu, 2));
+    CHECK(state_is(cpu, 8));
+    CHECK(buffer->count == 3);
+
+    // recording on, the snapshot after two deltas is a keyframe again, and the new deltas rebuild
+    record(buffer, cpu, 2);
+    CHECK(buffer->count == 5);
+    CHECK(snapshot_at(buffer, 3)->keyframe && !snapshot_at(buffer, 4)->keyframe);
+    CHECK(state_is(cpu, 10));
+    CHECK(rewind_step_back(buffer, cpu, 1));
+    CHECK(state_is(cpu, 9));
+
+    // as far back as the history goes
+    CHECK(rewind_step_back(buffer, cpu, buffer->count - 1));
+    CHECK(state_is(cpu, 6));
+    CHECK(buffer->count == 1);
+
+    // out of pages, the oldest keyframe and its deltas went to make room for the next
+    unsigned oldest = SNAPSHOTS - few_pages->count;
+
+    CHECK(oldest > 0 && oldest % KEYFRAME_INTERVAL == 0);
+    CHECK(snapshot_at(few_pages, 0)->keyframe);
+    CHECK(few_pages->page_head - few_pages->page_tail <= few_pages->page_capacity);
+    CHECK(rewind_step_back(few_pages, cpu, few_pages->count - 1));
+    CHECK(state_is(cpu, oldest));
+
+    rewind_free(few_pages);
+    rewind_free(buffer);
+    free_cpu(cpu);
+
+    return test_result();
+}
@@ -0,0 +1,45 @@
+#include <test.h>
+#include <savestate.h>
+
+/*
+ * Loading a state starts a machine afresh from it, on every engine, even
+ * one an undefined opcode stopped: the saved program, with the opcode
+ * patched out of the state, runs on to its HLT.
+ */
+
+#define UNDEFINED 0x0104
+
+static const uint8_t program[] = {
+    0x3E, 0x42,             // 0100 MVI A,42h
+    0x06, 0x07,             // 0102 MVI B,07h
+    0xCB,                   // 0104 undefined
+    0x76                    // 0105 HLT
+};
+
+static MachineState state;
+
+int main()
+{
+    for (Engine engine = 0; engine < ENGINE_COUNT; engine++)
+    {
+        Cpu8080 *cpu = test_machine(program, sizeof(program), engine);
+
+        save_state(cpu, &state);
+
+        CHECK(run_cycles(cpu, 1000000).reason == STOP_UNIMPLEMENTED);
+        CHECK(run_cycles(cpu, 1000000).reason == STOP_UNIMPLEMENTED);
+
+        state.memory[UNDEFINED] = 0x00;     // NOP
+        CHECK(load_state(cpu, &state));
+
+        RunResult result = run_cycles(cpu, 1000000);
+
+        CHECK(result.reason == STOP_HALT);
+        CHECK(result.instructions == 4);
+        CHECK(cpu->registers.A == 0x42 && cpu->registers.B == 0x07);
+
+        free_cpu(cpu);
+    }
+
+    return test_result();
+}
@@ -0,0 +1,118 @@
+#include <test.h>
+
+/*
+ * Self-modifying code and data next to code, on every engine. A routine is
+ * called until the block engines have cached and translated it, then one
+ * of its immediates is patched: the next call must see the new byte. A
+ * block storing into its own later instructions, cached, translated or
+ * fused into a superinstruction, must run the bytes it stored and charge
+ * only the instructions that ran. A loop storing data onto its own page
+ * must keep its translation.
+ */
+
+#define RESULT 0x0230
+
+static const uint8_t patched_routine[] = {
+    0x06, 0x40,             // 0100 MVI B,40h
+    0xCD, 0x20, 0x01,       // 0102 loop: CALL routine
+    0x78,                   // 0105 MOV A,B
+    0xFE, 0x10,             // 0106 CPI 10h
+    0xC2, 0x26, 0x01,       // 0108 JNZ next
+    0x3E, 'B',              // 010B MVI A,'B'
+    0x32, 0x21, 0x01,       // 010D STA routine+1
+    0xCD, 0x20, 0x01,       // 0110 CALL routine
+    0x76,                   // 0113 HLT
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0x3E, 'A',              // 0120 routine: MVI A,'A'
+    0x32, RESULT & 0xFF, RESULT >> 8,   // 0122 STA RESULT
+    0xC9,                   // 0125 RET
+    0x05,                   // 0126 next: DCR B
+    0xC2, 0x02, 0x01,       // 0127 JNZ loop
+    0x76                    // 012A HLT
+};
+
+// each pass stores to H=B, the last one into the MVI C that follows
+#define PASSES 0x40
+#define CYCLES(opcode) ((unsigned)INSTRUCTION_CYCLES[opcode])
+#define PATCHED_CYCLES (CYCLES(0x06) + CYCLES(0x2E) + CYCLES(0x76) + \
+                        PASSES * (CYCLES(0x60) + CYCLES(0x36) + CYCLES(0x0E) + CYCLES(0x05) + CYCLES(0xC2)))
+
+static const uint8_t patched_block[] = {
+    0x06, PASSES,           // 0100 MVI B,PASSES
+    0x2E, 0x08,             // 0102 MVI L,08h
+    0x60,                   // 0104 loop: MOV H,B
+    0x36, 0x99,             // 0105 MVI M,99h
+    0x0E, 0x11,             // 0107 MVI C,11h
+    0x05,                   // 0109 DCR B
+    0xC2, 0x04, 0x01,       // 010A JNZ loop
+    0x76                    // 010D HLT
+};
+
+// the MOV turns the INX after it into a DCX
+static const uint8_t patched_pair[] = {
+    0x3E, 0x2B,             // 0100 MVI A,2Bh
+    0x21, 0x06, 0x01,       // 0102 LXI H,0106h
+    0x77,                   // 0105 MOV M,A
+    0x23,                   // 0106 INX H
+    0x76                    // 0107 HLT
+};
+
+static const uint8_t data_on_code_page[] = {
+    0x21, 0x80, 0x01,       // 0100 LXI H,0180h
+    0x06, 0x00,             // 0103 MVI B,0
+    0x70,                   // 0105 loop: MOV M,B
+    0x05,                   // 0106 DCR B
+    0xC2, 0x05, 0x01,       // 0107 JNZ loop
+    0x76                    // 010A HLT
+};
+
+int main()
+{
+    for (Engine engine = 0; engine < ENGINE_COUNT; engine++)
+    {
+        Cpu8080 *cpu = test_machine(patched_routine, sizeof(patched_routine), engine);
+        RunResult result = run_cycles(cpu, 1000000);
+
+        CHECK(result.reason == STOP_HALT);
+        CHECK(cpu->memory[RESULT] == 'B');
+
+        free_cpu(cpu);
+
+        cpu = test_machine(patched_block, sizeof(patched_block), engine);
+        result = run_cycles(cpu, 1000000);
+
+        CHECK(result.reason == STOP_HALT);
+        CHECK(result.instructions == 3 + PASSES * 5);
+        CHECK(result.cycles == PATCHED_CYCLES);
+        CHECK(cpu->registers.C == 0x99);
+        CHECK(cpu->memory[0x0108] == 0x99);
+
+        free_cpu(cpu);
+
+        cpu = test_machine(patched_pair, sizeof(patched_pair), engine);
+        result = run_cycles(cpu, 1000000);
+
+        CHECK(result.reason == STOP_HALT);
+        CHECK(result.instructions == 5);
+        CHECK(result.cycles == CYCLES(0x3E) + CYCLES(0x21) + CYCLES(0x77) + CYCLES(0x2B) + CYCLES(0x76));
+        CHECK(cpu->registers.HL == 0x0105);
+
+        free_cpu(cpu);
+    }
+
+    Cpu8080 *cpu = test_machine(data_on_code_page, sizeof(data_on_code_page), ENGINE_JIT);
+
+    if (cpu->jit)
+    {
+        RunResult result = run_cycles(cpu, 1000000);
+
+        CHECK(result.reason == STOP_HALT);
+        CHECK(cpu->memory[0x0180] == 0x01);
+        CHECK(jit_lookup(cpu->jit, 0x0105) != NULL);
+        CHECK(cpu->jit->code_bytes[0x0180] == 0);
+    }
+
+    free_cpu(cpu);
+
+    return test_result();
+}
@@ -0,0 +1,68 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cpu.h>
+
+/*
+ * Shared by the headless tests, one program per file in tests/ built and
+ * run by `make check`. A failing CHECK reports where and on what, and the
+ * test carries on; main() returns test_result().
+ */
+
+static int test_failures;
+static const char *test_context = "";
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: [%s] CHECK(%s) failed\n", __FILE__, __LINE__, test_context, #condition); \
+            test_failures++; \
+        } \
+    } while (0)
+
+static inline int test_result()
+{
+    return test_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+typedef enum Engine {
+    ENGINE_INTERPRETER,
+    ENGINE_BLOCK_CACHE,
+    ENGINE_JIT,
+    ENGINE_COUNT
+} Engine;
+
+static inline const char* engine_name(Engine engine)
+{
+    static const char *names[ENGINE_COUNT] = { "interpreter", "block cache", "JIT" };
+
+    return names[engine];
+}
+
+/* Load address of test programs, as for CP/M */
+#define TEST_PROGRAM_START 0x0100
+
+/* A machine with flat RAM, program at TEST_PROGRAM_START and engine enabled */
+static inline Cpu8080* test_machine(const uint8_t *program, size_t size, Engine engine)
+{
+    Cpu8080 *cpu = init_cpu();
+
+    memcpy(cpu->memory + TEST_PROGRAM_START, program, size);
+    cpu->registers.pc = TEST_PROGRAM_START;
+    cpu->registers.sp = 0xF000;
+
+    if (engine >= ENGINE_BLOCK_CACHE)
+        enable_block_cache(cpu);
+
+    if (engine >= ENGINE_JIT)
+        enable_jit(cpu);
+
+    test_context = engine_name(engine);
+
+    return cpu;
+}
+
+#endif
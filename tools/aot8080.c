@@ -0,0 +1,507 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+
+#include <cpu.h>
+
+/*
+ * aot8080: ahead-of-time translation of an 8080 ROM image into C.
+ *
+ *   aot8080 [-b base] [-e entry]... rom output.c
+ *
+ * Code is discovered by following every static control transfer from the
+ * entry points (the load address, plus the RST vectors when loading at 0).
+ * Each basic block becomes a label in aot_run() (see include/aot.h) and
+ * static jumps and calls between blocks become gotos. Moves, loads, stores
+ * and jumps are written out as plain C; the other instructions go through
+ * execute_op(), so they share the interpreter's flag and port semantics.
+ * RET, RST, PCHL and conditional calls and returns leave through a switch
+ * on registers.pc, and anything it does not know is left to the interpreter.
+ * The image itself is written out too, for the emulator to check it against
+ * the ROM it loads.
+ */
+
+#define ADDRESS_SPACE   0x10000
+#define MAX_BLOCK_OPS   32
+
+static uint8_t image[ADDRESS_SPACE];
+static uint32_t image_start, image_end;         // [start, end)
+static bool visited[ADDRESS_SPACE];
+static bool label[ADDRESS_SPACE];
+
+static uint16_t worklist[ADDRESS_SPACE];
+static unsigned worklist_size;
+
+static const char *REGISTER_NAME[8] = { "B", "C", "D", "E", "H", "L", NULL, "A" };
+static const char *PAIR_NAME[3] = { "BC", "DE", "HL" };
+
+static void usage()
+{
+    fprintf(stderr, "usage: aot8080 [-b base] [-e entry]... rom output.c\n");
+    exit(EXIT_FAILURE);
+}
+
+static uint16_t parse_address(const char *text)
+{
+    char *end;
+    unsigned long value = strtoul(text, &end, 0);
+
+    if (*text == '\0' || *end != '\0' || value >= ADDRESS_SPACE) {
+        fprintf(stderr, "Invalid address: %s\n", text);
+        exit(EXIT_FAILURE);
+    }
+
+    return (uint16_t)value;
+}
+
+static void load_image(const char *path, uint16_t base)
+{
+    FILE *fp = fopen(path, "rb");
+
+    if (fp == NULL) {
+        fprintf(stderr, "Error opening %s: %s\n", path, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    size_t size = fread(image + base, 1, ADDRESS_SPACE - base, fp);
+
+    if (ferror(fp)) {
+        fprintf(stderr, "Error reading %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    fclose(fp);
+
+    if (size == 0) {
+        fprintf(stderr, "%s is empty\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    image_start = base;
+    image_end = base + size;
+}
+
+/* The instruction at address lies entirely inside the image and can be translated */
+static bool translatable(uint32_t address)
+{
+    return address >= image_start && address < image_end &&
+           address + INSTRUCTION_LENGTH[image[address]] <= image_end &&
+           !INSTRUCTION_UNDEFINED[image[address]];
+}
+
+static inline uint16_t operand16(uint16_t address)
+{
+    return image[address + 1] | image[address + 2] << 8;
+}
+
+static inline bool is_jcc(uint8_t opcode)  { return (opcode & 0xC7) == 0xC2; }
+static inline bool is_ccc(uint8_t opcode)  { return (opcode & 0xC7) == 0xC4; }
+static inline bool is_rcc(uint8_t opcode)  { return (opcode & 0xC7) == 0xC0; }
+static inline bool is_rst(uint8_t opcode)  { return (opcode & 0xC7) == 0xC7; }
+
+/* Control leaves the straight line after this instruction */
+static bool transfers_control(uint8_t opcode)
+{
+    return opcode == 0xC3 || opcode == 0xCD || opcode == 0xC9 || opcode == 0xE9 || opcode == 0x76 ||
+           is_jcc(opcode) || is_ccc(opcode) || is_rcc(opcode) || is_rst(opcode);
+}
+
+static void add_label(uint32_t address)
+{
+    if (address >= ADDRESS_SPACE || !translatable(address))
+        return;
+
+    label[address] = true;
+
+    if (!visited[address])
+    {
+        visited[address] = true;
+        worklist[worklist_size++] = address;
+    }
+}
+
+/* Walk every path from the entry points, marking block entries */
+static void discover()
+{
+    while (worklist_size > 0)
+    {
+        uint32_t address = worklist[--worklist_size];
+
+        while (translatable(address))
+        {
+            uint8_t opcode = image[address];
+            uint32_t next = address + INSTRUCTION_LENGTH[opcode];
+
+            if (opcode == 0xC3 || is_jcc(opcode) || opcode == 0xCD || is_ccc(opcode))
+                add_label(operand16(address));
+            else if (is_rst(opcode))
+                add_label(opcode & 0x38);
+
+            /* Return points and not-taken branches start blocks of their own */
+            if (is_jcc(opcode) || opcode == 0xCD || is_ccc(opcode) || is_rcc(opcode) || is_rst(opcode))
+                add_label(next);
+
+            if (transfers_control(opcode) || next >= ADDRESS_SPACE)
+                break;
+
+            if (visited[next])
+                break;
+
+            visited[next] = true;
+            address = next;
+        }
+    }
+}
+
+/* Cap straight-line runs at MAX_BLOCK_OPS so each one fits between interrupt points */
+static void split_long_blocks()
+{
+    for (uint32_t start = 0; start < ADDRESS_SPACE; start++)
+    {
+        if (!label[start])
+            continue;
+
+        uint32_t address = start;
+        unsigned ops = 0;
+
+        while (translatable(address) && !transfers_control(image[address]))
+        {
+            address += INSTRUCTION_LENGTH[image[address]];
+
+            if (address >= ADDRESS_SPACE || label[address])
+                break;
+
+            if (++ops == MAX_BLOCK_OPS)
+            {
+                add_label(address);
+                break;
+            }
+        }
+    }
+}
+
+static bool dispatch_used;
+
+/* A single statement continuing at target */
+static void emit_jump(FILE *out, const char *indent, uint32_t target)
+{
+    if (target < ADDRESS_SPACE && label[target])
+        fprintf(out, "%sgoto L_%04X;\n", indent, target);
+    else
+    {
+        fprintf(out, "%s{\n%s    r->pc = 0x%04X;\n%s    goto dispatch;\n%s}\n",
+                indent, indent, target & 0xFFFF, indent, indent);
+        dispatch_used = true;
+    }
+}
+
+static void emit_execute(FILE *out, uint16_t address)
+{
+    uint8_t opcode = image[address];
+    uint16_t operand = 0;
+
+    if (INSTRUCTION_LENGTH[opcode] == 2)
+        operand = image[address + 1];
+    else if (INSTRUCTION_LENGTH[opcode] == 3)
+        operand = operand16(address);
+
+    fprintf(out, "    execute_op(cpu, 0x%02X, 0x%04X);\n", opcode, operand);
+}
+
+/* Straight-line instructions with a plain C equivalent; returns false for the rest */
+static bool emit_inline(FILE *out, uint16_t address)
+{
+    uint8_t opcode = image[address];
+    uint8_t d8 = image[(uint16_t)(address + 1)];
+    uint16_t d16 = operand16(address);
+    const char *dst = REGISTER_NAME[(opcode >> 3) & 7];
+    const char *src = REGISTER_NAME[opcode & 7];
+
+    if (opcode >= 0x40 && opcode < 0x80 && opcode != 0x76)
+    {
+        char value[32];
+
+        if (src)
+            snprintf(value, sizeof(value), "r->%s", src);
+        else
+            snprintf(value, sizeof(value), "AOT_MEM(r->HL)");
+
+        if (dst == NULL)
+            fprintf(out, "    store_byte(cpu, r->HL, %s);\n", value);
+        else if (dst != src)
+            fprintf(out, "    r->%s = %s;\n", dst, value);
+
+        return true;
+    }
+
+    if ((opcode & 0xC7) == 0x06)
+    {
+        if (dst == NULL)
+            fprintf(out, "    store_byte(cpu, r->HL, 0x%02X);\n", d8);
+        else
+            fprintf(out, "    r->%s = 0x%02X;\n", dst, d8);
+
+        return true;
+    }
+
+    switch (opcode)
+    {
+        case 0x00: case 0x08: case 0x10: case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:
+            return true;
+
+        case 0x01: case 0x11: case 0x21:
+            fprintf(out, "    r->%s = 0x%04X;\n", PAIR_NAME[opcode >> 4], d16);
+            return true;
+
+        case 0x31:
+            fprintf(out, "    r->sp = 0x%04X;\n", d16);
+            return true;
+
+        case 0x02: case 0x12:
+            fprintf(out, "    store_byte(cpu, r->%s, r->A);\n", PAIR_NAME[opcode >> 4]);
+            return true;
+
+        case 0x0A: case 0x1A:
+            fprintf(out, "    r->A = AOT_MEM(r->%s);\n", PAIR_NAME[opcode >> 4]);
+            return true;
+
+        case 0x03: case 0x13: case 0x23:
+        case 0x0B: case 0x1B: case 0x2B:
+            fprintf(out, "    r->%s%s;\n", PAIR_NAME[opcode >> 4], (opcode & 0x08) ? "--" : "++");
+            return true;
+
+        case 0x33:
+            fprintf(out, "    r->sp++;\n");
+            return true;
+
+        case 0x3B:
+            fprintf(out, "    r->sp--;\n");
+            return true;
+
+        case 0x22:
+            fprintf(out, "    store_byte(cpu, 0x%04X, r->L);\n    store_byte(cpu, 0x%04X, r->H);\n",
+                    d16, (uint16_t)(d16 + 1));
+            return true;
+
+        case 0x2A:
+            fprintf(out, "    r->L = AOT_MEM(0x%04X);\n    r->H = AOT_MEM(0x%04X);\n",
+                    d16, (uint16_t)(d16 + 1));
+            return true;
+
+        case 0x32:
+            fprintf(out, "    store_byte(cpu, 0x%04X, r->A);\n", d16);
+            return true;
+
+        case 0x3A:
+            fprintf(out, "    r->A = AOT_MEM(0x%04X);\n", d16);
+            return true;
+
+        case 0x2F:
+            fprintf(out, "    r->A = ~r->A;\n");
+            return true;
+
+        case 0xEB:
+            fprintf(out, "    {\n        uint16_t hl = r->HL;\n"
+                         "        r->HL = r->DE;\n        r->DE = hl;\n    }\n");
+            return true;
+    }
+
+    return false;
+}
+
+static const char* jump_condition(uint8_t opcode)
+{
+    static const char *CONDITION[8] = { "NZ", "Z", "NC", "C", "PO", "PE", "P", "M" };
+
+    return CONDITION[(opcode >> 3) & 7];
+}
+
+static void emit_block(FILE *out, uint16_t start)
+{
+    uint32_t address = start;
+    unsigned ops = 0;
+    unsigned cycles = 0;
+    unsigned taken_cycles = 0;     // with the last instruction a taken conditional CALL or RET
+
+    /* Size the block first: AOT_BLOCK retires it as a whole */
+    while (translatable(address))
+    {
+        uint8_t opcode = image[address];
+
+        ops++;
+        taken_cycles = cycles + INSTRUCTION_CYCLES_TAKEN[opcode];
+        cycles += INSTRUCTION_CYCLES[opcode];
+        address += INSTRUCTION_LENGTH[opcode];
+
+        if (transfers_control(opcode) || address >= ADDRESS_SPACE || label[address])
+            break;
+    }
+
+    fprintf(out, "\nL_%04X:\n    AOT_BLOCK(0x%04X, 0x%04X, %u, %u, %u);\n",
+            start, start, (unsigned)(address - 1), ops, cycles, taken_cycles);
+
+    address = start;
+
+    for (unsigned i = 0; i < ops; i++)
+    {
+        uint8_t opcode = image[address];
+        uint32_t next = address + INSTRUCTION_LENGTH[opcode];
+
+        fprintf(out, "    /* %04X: ", address);
+        for (uint32_t byte = address; byte < next; byte++)
+            fprintf(out, "%02X ", image[byte]);
+        fprintf(out, "*/\n");
+
+        if (opcode == 0xC3)
+            emit_jump(out, "    ", operand16(address));
+        else if (is_jcc(opcode))
+        {
+            fprintf(out, "    if (AOT_COND_%s)\n", jump_condition(opcode));
+            emit_jump(out, "        ", operand16(address));
+            emit_jump(out, "    ", next);
+        }
+        else if (opcode == 0xCD)
+        {
+            fprintf(out, "    r->pc = 0x%04X;\n", address);
+            emit_execute(out, address);
+            emit_jump(out, "    ", operand16(address));
+        }
+        else if (opcode == 0x76)
+        {
+            /* HLT ends the run */
+            fprintf(out, "    r->pc = 0x%04X;\n", address);
+            emit_execute(out, address);
+            fprintf(out, "    return executed;\n");
+        }
+        else if (transfers_control(opcode))
+        {
+            /* The interpreter's handler computes the next PC */
+            fprintf(out, "    r->pc = 0x%04X;\n", address);
+            emit_execute(out, address);
+            fprintf(out, "    goto dispatch;\n");
+            dispatch_used = true;
+        }
+        else if (!emit_inline(out, address))
+            emit_execute(out, address);
+
+        if (!transfers_control(opcode) && i == ops - 1)
+            emit_jump(out, "    ", next);
+
+        address = next;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    uint16_t base = 0;
+    uint16_t entries[ADDRESS_SPACE];
+    unsigned entry_count = 0;
+    int arg = 1;
+
+    for (; arg < argc && argv[arg][0] == '-'; arg++)
+    {
+        if (arg + 1 >= argc)
+            usage();
+
+        if (strcmp(argv[arg], "-b") == 0)
+            base = parse_address(argv[++arg]);
+        else if (strcmp(argv[arg], "-e") == 0)
+            entries[entry_count++] = parse_address(argv[++arg]);
+        else
+            usage();
+    }
+
+    if (argc - arg != 2)
+        usage();
+
+    const char *rom_path = argv[arg];
+    const char *out_path = argv[arg + 1];
+
+    load_image(rom_path, base);
+
+    add_label(base);
+
+    /* Interrupts enter through the RST vectors of a ROM mapped at 0 */
+    if (base == 0)
+        for (uint16_t vector = 0; vector <= 0x38; vector += 8)
+            add_label(vector);
+
+    for (unsigned i = 0; i < entry_count; i++)
+        add_label(entries[i]);
+
+    discover();
+    split_long_blocks();
+
+    FILE *body = tmpfile();
+
+    if (body == NULL) {
+        perror("Error creating temporary file");
+        return EXIT_FAILURE;
+    }
+
+    unsigned blocks = 0;
+
+    for (uint32_t address = 0; address < ADDRESS_SPACE; address++)
+    {
+        if (label[address])
+        {
+            emit_block(body, address);
+            blocks++;
+        }
+    }
+
+    FILE *out = fopen(out_path, "w");
+
+    if (out == NULL) {
+        fprintf(stderr, "Error opening %s: %s\n", out_path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    fprintf(out, "/* Generated by aot8080 from %s (base 0x%04X), do not edit */\n\n", rom_path, base);
+    fprintf(out, "#include <aot.h>\n\n");
+    fprintf(out, "const uint32_t aot_image_start = 0x%04X;\n", image_start);
+    fprintf(out, "const uint32_t aot_image_end = 0x%04X;\n\n", image_end);
+    fprintf(out, "const uint8_t aot_image[] = {");
+
+    for (uint32_t address = image_start; address < image_end; address++)
+        fprintf(out, "%s0x%02X,", (address - image_start) % 16 ? " " : "\n    ", image[address]);
+
+    fprintf(out, "\n};\n\n");
+    fprintf(out, "uint64_t aot_run(Cpu8080 *cpu, uint64_t cycle_limit, uint64_t budget)\n{\n");
+    fprintf(out, "    Registers *r = &cpu->registers;\n    uint64_t executed = 0;\n\n");
+
+    if (dispatch_used)
+        fprintf(out, "dispatch:\n");
+
+    fprintf(out, "    switch (r->pc)\n    {\n");
+
+    for (uint32_t address = 0; address < ADDRESS_SPACE; address++)
+        if (label[address])
+            fprintf(out, "        case 0x%04X: goto L_%04X;\n", address, address);
+
+    fprintf(out, "        default: return executed;\n    }\n");
+
+    rewind(body);
+
+    char buffer[4096];
+    size_t length;
+
+    while ((length = fread(buffer, 1, sizeof(buffer), body)) > 0)
+        fwrite(buffer, 1, length, out);
+
+    fprintf(out, "}\n");
+
+    if (fclose(out) != 0) {
+        fprintf(stderr, "Error writing %s: %s\n", out_path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    fclose(body);
+
+    printf("aot8080: %u blocks from %s\n", blocks, rom_path);
+
+    return EXIT_SUCCESS;
+}